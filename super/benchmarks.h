@@ -0,0 +1,715 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "entities.h"
+#include "entity_update.h"
+#include "flow_field.h"
+#include "movement.h"
+#include "path_service.h"
+#include "spatial_index.h"
+#include "view_culling.h"
+
+// Runs fn `iterations` times and returns the average time per call in
+// microseconds
+template <typename Fn>
+double bench_avg_us(int iterations, Fn fn) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++) fn(i);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() /
+           iterations;
+}
+
+// Lays out `num` shelves in rows like SuperLayer does (one aisle every
+// other row) and compares a REACH_DIST query against a full entity scan
+inline void bench_spatial_index() {
+    log_info("spatial index: avg REACH_DIST query time vs store size");
+    const int queries = 2000;
+
+    for (int num : {100, 1000, 10000, 50000}) {
+        SpatialHash grid;
+        std::vector<std::shared_ptr<Entity>> all;
+        int side = (int)std::ceil(std::sqrt(num));
+        for (int i = 0; i < num; i++) {
+            auto shelf = std::make_shared<Shelf>(
+                glm::vec2{1.f * (i % side), 2.f * (i / side)},
+                glm::vec2{1.f, 1.f}, 0.f, glm::vec4{1.f}, "shelf");
+            all.push_back(shelf);
+            grid.insert(shelf);
+        }
+
+        std::vector<glm::vec2> points;
+        for (int i = 0; i < queries; i++) {
+            points.push_back(glm::vec2{randIn(0, side), randIn(0, side * 2)});
+        }
+
+        int found = 0;
+        double scan = bench_avg_us(queries, [&](int i) {
+            for (auto& e : all) {
+                auto s = dynamic_pointer_cast<Shelf>(e);
+                if (s && glm::distance(points[i], s->position) < REACH_DIST)
+                    found++;
+            }
+        });
+        double hashed = bench_avg_us(queries, [&](int i) {
+            glm::vec2 p = points[i];
+            grid.forEachInRect(
+                glm::vec4{p.x - REACH_DIST, p.y - REACH_DIST,
+                          p.x + REACH_DIST, p.y + REACH_DIST},
+                [&](const std::shared_ptr<Entity>& e) {
+                    auto s = dynamic_pointer_cast<Shelf>(e);
+                    if (s && glm::distance(p, s->position) < REACH_DIST)
+                        found--;
+                    return EntityHelper::ForEachFlow::None;
+                });
+        });
+        M_ASSERT(found == 0, "grid and scan should find the same shelves");
+        log_info("{:>6} shelves: scan {:>9.2f}us  grid {:>6.2f}us", num, scan,
+                 hashed);
+    }
+}
+
+template <typename T>
+T percentile(std::vector<T> samples, float p) {
+    if (samples.empty()) return T();
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)(p * (samples.size() - 1));
+    return samples[index];
+}
+
+// Every 30 frames a wave of agents all want a new path at once (like
+// customers picking up FindItem jobs) and we measure how long each frame
+// takes to submit / poll them. Frames are padded out to 4ms so the workers
+// get time to run like they would in game
+inline void bench_path_service() {
+    log_info("path service: frame time with a wave of path requests");
+    const int frames = 240;
+    const auto frameBudget = std::chrono::milliseconds(4);
+    const int agents = 50;
+    const glm::vec2 agentSize = {0.6f, 0.6f};
+
+    // same layout as the default store
+    OccupancyGrid& grid = Occupancy::grid();
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 10; j += 2) {
+            grid.add(-(i * 10 + j) - 1, glm::vec2{1.f + i, -3.f + j},
+                     glm::vec2{1.f, 1.f});
+        }
+    }
+
+    for (bool useWorkers : {false, true}) {
+        PathService& service = PathService::get();
+        service.useWorkers = useWorkers;
+
+        std::vector<PathTicket> tickets(agents);
+        std::vector<double> frameTimes;
+        int completed = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            // every wave asks for the same paths, we want to time the
+            // searches not the PathCache
+            if (frame % 30 == 0) service.cache.clear();
+            for (int a = 0; a < agents; a++) {
+                auto& ticket = tickets[a];
+                if (ticket && ticket->done) {
+                    completed++;
+                    ticket.reset();
+                }
+                if (!ticket && frame % 30 == 0) {
+                    ticket = service.submit(
+                        glm::vec2{-5.f, -5.f + a * 0.2f},
+                        glm::vec2{7.f, 6.f - a * 0.2f}, agentSize);
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            frameTimes.push_back(
+                std::chrono::duration<double, std::milli>(end - start)
+                    .count());
+            std::this_thread::sleep_until(start + frameBudget);
+        }
+        for (auto& ticket : tickets) {
+            if (!ticket) continue;
+            while (!ticket->done) std::this_thread::yield();
+            completed++;
+        }
+        log_info("{:>7}: p50 {:.3f}ms p99 {:.3f}ms max {:.3f}ms ({} paths)",
+                 useWorkers ? "workers" : "sync",
+                 percentile(frameTimes, 0.5f), percentile(frameTimes, 0.99f),
+                 percentile(frameTimes, 1.f), completed);
+    }
+    PathService::get().stop();
+    grid.clear();
+}
+
+// Cost of sharing one flow field between a lot of agents: one build and
+// then a sample per agent per tick
+inline void bench_flow_field() {
+    log_info("flow field: build once, sample per agent");
+    const glm::vec2 agentSize = {0.6f, 0.6f};
+    const int agents = 5000;
+
+    for (int side : {20, 100, 200}) {
+        OccupancyGrid grid;
+        int id = 0;
+        for (int x = 0; x < side; x += 2) {
+            for (int y = 0; y < side; y += 3) {
+                grid.add(id++, glm::vec2{x, y}, glm::vec2{1.f, 2.f});
+            }
+        }
+        auto& layer = grid.layerFor(agentSize);
+        glm::vec2 goal = {0.f, -2.f};
+
+        FlowField field;
+        double build = bench_avg_us(1, [&](int) {
+            field = FlowField::build(grid, layer, goal);
+        });
+
+        std::vector<glm::vec2> positions;
+        for (int i = 0; i < agents; i++) {
+            positions.push_back(glm::vec2{randIn(0, side), randIn(0, side)} +
+                                glm::vec2{0.2f, 0.2f});
+        }
+        int found = 0;
+        double sample = bench_avg_us(agents, [&](int i) {
+            if (field.target(positions[i], goal)) found++;
+        });
+        log_info("{:>3}x{:<3} store ({} shelves): build {:.2f}ms, "
+                 "{:.3f}us per agent ({} in field)",
+                 side, side, id, build / 1000.0, sample, found);
+    }
+}
+
+// Warehouse sized floor plan: 500x500 tiles of shelf rows with cross aisles
+inline void bench_path_hierarchy() {
+    log_info("path hierarchy: 500x500 tile warehouse");
+    const glm::vec2 agentSize = {0.6f, 0.6f};
+    const int side = 500;
+
+    OccupancyGrid grid;
+    int id = 0;
+    for (int x = 0; x < side; x += 3) {
+        for (int y = 0; y < side; y += 20) {
+            grid.add(id++, glm::vec2{x, y}, glm::vec2{1.f, 18.f});
+        }
+    }
+    auto& layer = grid.layerFor(agentSize);
+
+    double build = bench_avg_us(1, [&](int) { PathHierarchy::refresh(grid); });
+    log_info("{} shelves, {} clusters: full build {:.1f}ms", id,
+             layer.nav.clusters.size(), build / 1000.0);
+
+    // what DragArea does, one shelf at a time
+    double edit = bench_avg_us(20, [&](int i) {
+        grid.add(id + i, glm::vec2{1.5f + 3 * i * 7, 18.5f},
+                 glm::vec2{1.f, 1.f});
+        PathHierarchy::refresh(grid);
+    });
+    log_info("place one shelf + rebuild: {:.1f}us", edit);
+
+    std::vector<double> samples;
+    int found = 0;
+    for (int i = 0; i < 200; i++) {
+        // start and end in the aisles
+        glm::vec2 start = {3.f * randIn(0, side / 3) + 1.7f, randIn(0, side)};
+        glm::vec2 end = {3.f * randIn(0, side / 3) + 1.7f, randIn(0, side)};
+        samples.push_back(bench_avg_us(1, [&](int) {
+            if (!PathHierarchy::findPath(grid, layer, start, end).empty())
+                found++;
+        }));
+    }
+    log_info("{} / {} found, p50 {:.0f}us p99 {:.0f}us max {:.0f}us", found,
+             samples.size(), percentile(samples, 0.5f),
+             percentile(samples, 0.99f), percentile(samples, 1.f));
+}
+
+// 100k queued employee jobs (a tenth of them reserved), idle agents pick
+// one up and finish it. Compared against the old map of vectors which
+// copied each vector on every lookup
+inline void bench_job_queue() {
+    log_info("job queue: pick + complete with 100k queued jobs");
+    const int queued = 100000;
+    const JobType types[] = {JobType::IdleWalk, JobType::DirectedWalk,
+                             JobType::Empty, JobType::Fill};
+    JobRange range = {JobType::None, JobType::INVALID_Customer_Boundary};
+
+    std::vector<std::shared_ptr<Job>> all;
+    for (int i = 0; i < queued; i++) {
+        JobType t = types[i % 4];
+        all.push_back(std::make_shared<Job>(
+            Job({.type = t, .reserved = i % 10 == 0 ? i % 1000 : -1})));
+    }
+
+    std::map<int, std::vector<std::shared_ptr<Job>>> old;
+    for (auto& j : all) old[(int)j->type].push_back(j);
+    auto oldNext = [&](int e_id) -> std::shared_ptr<Job> {
+        for (int i = (int)range.end; i >= range.start; i--) {
+            auto js = old[i];
+            for (auto it = js.begin(); it != js.end(); it++) {
+                if ((*it)->isAssigned() || (*it)->isComplete) continue;
+                if ((*it)->reserved != -1 && (*it)->reserved != e_id) continue;
+                return *it;
+            }
+        }
+        return nullptr;
+    };
+    const int oldPicks = 200;
+    double before = bench_avg_us(oldPicks, [&](int i) {
+        auto j = oldNext(i % 1000);
+        if (j) j->state = JobState::Claimed;
+    });
+    for (auto& j : all) j->state = JobState::Open;
+
+    JobQueue::clear();
+    double add = bench_avg_us(queued, [&](int i) {
+        JobQueue::addJob(all[i]->type, *all[i]);
+    });
+    double flush = bench_avg_us(1, [&](int) { JobQueue::flush(); });
+    // flush every 100 picks like a tick would
+    const int picks = 50000;
+    double pick = bench_avg_us(picks, [&](int i) {
+        auto j = JobQueue::getNextInRange(i % 1000, range);
+        if (j) JobQueue::complete(j);
+        if (i % 100 == 99) JobQueue::flush();
+    });
+    log_info("map of vectors: {:.1f}us per pick", before);
+    log_info("indexed: {:.3f}us per add, {:.0f}us to flush them all, {:.3f}us "
+             "per pick + complete",
+             add, flush, pick);
+    JobQueue::clear();
+}
+
+// Jobs come and go thousands of times a second (idle walks especially),
+// compares a heap allocated job per add against reusing pool slots
+inline void bench_job_churn() {
+    log_info("job churn: add + complete with 1k jobs in flight");
+    const int inFlight = 1000;
+    const int churn = 1000000;
+    Job job({.type = JobType::IdleWalk, .endPosition = {1.f, 1.f}});
+
+    std::vector<std::shared_ptr<Job>> heap(inFlight);
+    double shared = bench_avg_us(churn, [&](int i) {
+        heap[i % inFlight] = std::make_shared<Job>(job);
+    });
+    heap.clear();
+
+    JobQueue::clear();
+    std::vector<JobHandle> handles(inFlight);
+    for (auto& h : handles) h = JobQueue::addJob(JobType::IdleWalk, job);
+    JobQueue::flush();
+    int capacity = JobQueue::data().pool.capacity();
+    double pooled = bench_avg_us(churn, [&](int i) {
+        JobHandle& h = handles[i % inFlight];
+        JobQueue::complete(h);
+        h = JobQueue::addJob(JobType::IdleWalk, job);
+        // slots come back on flush, once a tick
+        if (i % inFlight == inFlight - 1) JobQueue::flush();
+    });
+    log_info("shared_ptr: {:.3f}us per job, pool: {:.3f}us per job", shared,
+             pooled);
+    log_info("pool capacity {} before, {} after", capacity,
+             JobQueue::data().pool.capacity());
+    JobQueue::clear();
+}
+
+// Simulated minute of employees doing Fill jobs in a 60x60 store with a
+// storage box in each corner. Workers walk in a straight line at a fixed
+// speed so this only measures the assignment, not the path finding
+inline void bench_job_assignment() {
+    log_info("job assignment: Fill jobs completed per simulated minute");
+    const float side = 60.f;
+    const float speed = 4.f;  // tiles per second
+    const float dt = 1.f / 60.f;
+    const int numWorkers = 20;
+    const int openJobs = 40;
+    const glm::vec2 storage[] = {
+        {0.f, 0.f}, {side, 0.f}, {0.f, side}, {side, side}};
+    JobRange range = {JobType::None, JobType::INVALID_Customer_Boundary};
+
+    auto simulate = [&](bool useAssigner) {
+        struct Worker {
+            int id;
+            glm::vec2 position;
+            JobHandle job;
+            bool pickedUp = false;
+        };
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> coord(0.f, side);
+        std::uniform_int_distribution<int> corner(0, 3);
+
+        JobQueue::clear();
+        JobAssigner::get().clear();
+        std::vector<Worker> workers;
+        for (int i = 0; i < numWorkers; i++) {
+            workers.push_back(Worker{i, {coord(rng), coord(rng)}, {}});
+        }
+
+        int completed = 0;
+        float walked = 0.f;
+        for (float t = 0.f; t < 60.f; t += dt) {
+            while (JobQueue::numOfJobsWithType(JobType::Fill) -
+                       JobQueue::numAssignedWithType(JobType::Fill) <
+                   openJobs) {
+                JobQueue::addJob(
+                    JobType::Fill,
+                    Job({.type = JobType::Fill,
+                         .startPosition = storage[corner(rng)],
+                         .endPosition = {coord(rng), coord(rng)}}));
+            }
+
+            for (Worker& w : workers) {
+                if (!w.job) {
+                    if (!useAssigner) {
+                        w.job = JobQueue::getNextInRange(w.id, range);
+                    } else if (!(w.job = JobAssigner::get().take(w.id))) {
+                        JobAssigner::get().request(w.id, w.position, range);
+                    }
+                    w.pickedUp = false;
+                    continue;
+                }
+                Job* job = JobQueue::get(w.job);
+                glm::vec2 target =
+                    w.pickedUp ? job->endPosition : job->startPosition;
+                glm::vec2 delta = target - w.position;
+                float len = glm::length(delta);
+                float step = std::min(len, speed * dt);
+                walked += step;
+                if (len > 0.f) w.position = w.position + delta * (step / len);
+                if (len > TRAVEL_DIST) continue;
+                if (!w.pickedUp) {
+                    w.pickedUp = true;
+                    continue;
+                }
+                JobQueue::complete(w.job);
+                w.job = JobHandle();
+                completed++;
+            }
+            // assign() flushes the queue itself
+            if (useAssigner) {
+                JobAssigner::get().assign();
+            } else {
+                JobQueue::flush();
+            }
+        }
+        JobAssigner::get().clear();
+        JobQueue::clear();
+        log_info("{:>16}: {} jobs/min, {:.1f} tiles walked per job",
+                 useAssigner ? "nearest worker" : "priority order",
+                 completed, walked / std::max(completed, 1));
+    };
+    simulate(false);
+    simulate(true);
+}
+
+// 4000 agents that each spend a couple microseconds thinking and then move,
+// one tick with the think phase on one thread vs spread over the pool
+inline void bench_entity_update() {
+    struct Thinker : public Entity {
+        float heading = 0.f;
+        virtual void onUpdate(Time) override {
+            for (int i = 0; i < 200; i++) heading = std::sin(heading + 0.1f);
+            Intents::move(*this, position + glm::vec2{heading, 0.f});
+        }
+        virtual const char* typeString() const override { return "Thinker"; }
+    };
+    std::vector<std::shared_ptr<Entity>> entities;
+    for (int i = 0; i < 4000; i++) {
+        entities.push_back(std::make_shared<Thinker>());
+    }
+
+    const int ticks = 50;
+    EntityUpdater serial;
+    serial.pool.numWorkers = 0;
+    EntityUpdater pooled;
+    log_info("entity update: 4000 agents, {} worker threads + main",
+             pooled.pool.numWorkers);
+    double one = bench_avg_us(
+        ticks, [&](int) { serial.update(entities, Time(0.016f)); });
+    double many = bench_avg_us(
+        ticks, [&](int) { pooled.update(entities, Time(0.016f)); });
+    log_info("serial: {:.0f}us per tick, pool: {:.0f}us per tick", one, many);
+}
+
+// Moving every agent one step through EntityUpdater, with each agent
+// sending an Intents::move like MovableEntity used to vs asking the
+// MovementStore and integrating everyone in one go
+inline void bench_movement() {
+    struct Walker : public MovableEntity {
+        glm::vec2 target;
+        bool useStore = true;
+        // the old per entity timer
+        float since = 0.f;
+        virtual void onUpdate(Time dt) override {
+            if (useStore) {
+                MovementStore::get().request(movement.index, this, target);
+                return;
+            }
+            since += dt.s();
+            if (since >= 0.025f) {
+                since = 0.f;
+                Intents::move(*this, lerp(position, target, 0.05f));
+            }
+        }
+        virtual const char* typeString() const override { return "Walker"; }
+    };
+
+    const int ticks = 50;
+    const float dt = 0.03f;
+    EntityUpdater updater;
+    MovementStore& store = MovementStore::get();
+    for (int num : {10000, 100000}) {
+        std::vector<std::shared_ptr<Entity>> entities;
+        std::vector<Walker*> walkers;
+        for (int i = 0; i < num; i++) {
+            auto w = std::make_shared<Walker>();
+            w->position = {(float)(i % 300), (float)(i / 300)};
+            w->target = w->position + glm::vec2{5.f, 3.f};
+            entities.push_back(w);
+            walkers.push_back(w.get());
+        }
+
+        for (Walker* w : walkers) w->useStore = false;
+        double intents = bench_avg_us(
+            ticks, [&](int) { updater.update(entities, Time(dt)); });
+        for (Walker* w : walkers) w->useStore = true;
+        double batched = bench_avg_us(ticks, [&](int) {
+            updater.update(entities, Time(dt));
+            store.integrate(dt);
+        });
+        double integrate = bench_avg_us(ticks, [&](int) {
+            for (int i = 0; i < store.size(); i++) {
+                store.moving[i] = store.owner[i] ? 1.f : 0.f;
+            }
+            store.integrate(dt);
+        });
+        log_info(
+            "movement: {} agents, intents {:.0f}us per tick, store {:.0f}us "
+            "({:.0f}us of that integrating)",
+            num, intents, batched, integrate);
+    }
+}
+
+// ItemGroup against the std::map it used to be: filling, reading and
+// emptying a lot of small groups (shelves, hands, carts), then adding up
+// every group like GameUILayer::getTotalInventory does
+inline void bench_item_group() {
+    const int groups = 20000;
+    const int rounds = 10;
+    auto idFor = [](int g, int i) { return (g * 7 + i * 131) % 1000; };
+
+    double mapOps = bench_avg_us(rounds, [&](int) {
+        std::vector<std::map<int, int>> all(groups);
+        int sum = 0;
+        for (int g = 0; g < groups; g++) {
+            for (int i = 0; i < 1 + g % 4; i++) all[g][idFor(g, i)] += 5;
+        }
+        for (int g = 0; g < groups; g++) {
+            for (int i = 0; i < 4; i++) {
+                auto it = all[g].find(idFor(g, i));
+                sum += it == all[g].end() ? 0 : it->second;
+            }
+            all[g].erase(idFor(g, 0));
+        }
+        M_ASSERT(sum > 0, "read something");
+    });
+    double flatOps = bench_avg_us(rounds, [&](int) {
+        std::vector<ItemGroup> all(groups);
+        int sum = 0;
+        for (int g = 0; g < groups; g++) {
+            for (int i = 0; i < 1 + g % 4; i++) all[g].addItem(idFor(g, i), 5);
+        }
+        for (int g = 0; g < groups; g++) {
+            for (int i = 0; i < 4; i++) sum += all[g].count(idFor(g, i));
+            all[g].removeItem(idFor(g, 0), 5);
+        }
+        M_ASSERT(sum > 0, "read something");
+    });
+
+    std::vector<std::map<int, int>> maps(groups);
+    std::vector<ItemGroup> flats(groups);
+    for (int g = 0; g < groups; g++) {
+        for (int i = 0; i < 4; i++) {
+            maps[g][idFor(g, i)] += 5;
+            flats[g].addItem(idFor(g, i), 5);
+        }
+    }
+    double mapTotal = bench_avg_us(rounds, [&](int) {
+        std::map<int, int> total;
+        for (auto& m : maps) {
+            for (auto& kv : m) total[kv.first] += kv.second;
+        }
+    });
+    double flatTotal = bench_avg_us(rounds, [&](int) {
+        ItemGroup total;
+        for (auto& f : flats) total.merge(f);
+    });
+    log_info(
+        "item groups: {} groups, fill/read/remove map {:.0f}us flat {:.0f}us, "
+        "total inventory map {:.0f}us flat {:.0f}us",
+        groups, mapOps, flatOps, mapTotal, flatTotal);
+}
+
+// 10k shelves each stocking one of 1k items, nearest shelf with a given
+// item from random spots in the store
+inline void bench_stock_index() {
+    const int numShelves = 10000;
+    const int numItems = 1000;
+    const int queries = 2000;
+    const int side = 100;
+
+    std::vector<std::shared_ptr<Shelf>> shelves;
+    for (int i = 0; i < numShelves; i++) {
+        auto shelf = std::make_shared<Shelf>(
+            glm::vec2{1.f * (i % side), 2.f * (i / side)}, glm::vec2{1.f, 1.f},
+            0.f, glm::vec4{1.f}, "shelf");
+        // spread each item around the store instead of one row
+        shelf->contents.addItem((i * 37) % numItems, 5);
+        SpatialIndex::grid().insert(shelf);
+        StockIndex::onLayoutChanged(shelf, true);
+        shelves.push_back(shelf);
+    }
+
+    Rng rng{1, 0};
+    std::vector<glm::vec2> points;
+    std::vector<int> wanted;
+    for (int i = 0; i < queries; i++) {
+        points.push_back(glm::vec2{rng.uniform(0.f, 1.f * side),
+                                   rng.uniform(0.f, 2.f * side)});
+        wanted.push_back(rng.range(0, numItems - 1));
+    }
+
+    std::vector<Shelf*> nearest(queries, nullptr);
+    int differ = 0;
+    double ring = bench_avg_us(queries, [&](int i) {
+        auto found =
+            SpatialIndex::searchWithItem<Shelf>(points[i], wanted[i], -1);
+        nearest[i] = found.empty() ? nullptr : found.front().get();
+    });
+    double indexed = bench_avg_us(queries, [&](int i) {
+        auto found = SpatialIndex::getEntityInRangeWithItem<Shelf>(
+            points[i], wanted[i], -1);
+        Shelf* s = found.empty() ? nullptr : found.front().get();
+        // ties can come back in either order
+        if (s != nearest[i] &&
+            (!s || !nearest[i] ||
+             glm::distance(points[i], s->position) !=
+                 glm::distance(points[i], nearest[i]->position)))
+            differ++;
+    });
+    M_ASSERT(differ == 0, "index and ring search should agree");
+    log_info(
+        "stock index: nearest of {} shelves with one of {} items, ring "
+        "search {:.2f}us, index {:.2f}us",
+        numShelves, numItems, ring, indexed);
+
+    for (auto& shelf : shelves) {
+        SpatialIndex::grid().remove(shelf->id);
+        StockIndex::onLayoutChanged(shelf, false);
+    }
+}
+
+// what pricing a shopping list cost when every call site took its own copy
+// of the catalog (GLOBALS.get returns by value) vs reading it in place
+inline void bench_item_catalog() {
+    ItemManager& items = ItemManager::get();
+    ItemManager saved = items;
+    const int numItems = 20000;
+    const int lists = 200;
+    items.generate(numItems);
+
+    float copied = 0.f;
+    float inPlace = 0.f;
+    double copying = bench_avg_us(lists, [&](int i) {
+        ItemManager im = ItemManager::get();
+        for (int j = 0; j < 4; j++)
+            copied += im.get_avg_price((i * 97 + j) % numItems);
+    });
+    double reading = bench_avg_us(lists, [&](int i) {
+        const ItemManager& im = ItemManager::get();
+        for (int j = 0; j < 4; j++)
+            inPlace += im.get_avg_price((i * 97 + j) % numItems);
+    });
+    M_ASSERT(copied == inPlace, "same prices either way");
+    log_info("item catalog: {} items, pricing a list copying {:.2f}us, "
+             "in place {:.3f}us",
+             numItems, copying, reading);
+    items = saved;
+}
+
+// Stands in for the renderer, there isnt one yet when the benchmarks run
+// (main returns before App::create). Mixes in every position so the
+// compiler cant skip the walk, while costing next to nothing itself so the
+// timings are just the game side
+struct QuadSink {
+    int quads = 0;
+    uint32_t checksum = 0;
+
+    // the quad Entity::render draws without any RenderOptions
+    void operator()(const Entity& e) {
+        uint32_t bits;
+        memcpy(&bits, &e.position.x, sizeof(bits));
+        quads++;
+        checksum ^= bits;
+    }
+};
+
+// zoomed in on one aisle of a 50k shelf store
+inline void bench_view_culling() {
+    const int numShelves = 50000;
+    const int frames = 50;
+    std::vector<std::shared_ptr<Entity>> all;
+    for (int i = 0; i < numShelves; i++) {
+        auto shelf = std::make_shared<Shelf>(
+            glm::vec2{1.f * (i % 250), 2.f * (i / 250)}, glm::vec2{1.f},
+            0.f, glm::vec4{1.f}, "shelf");
+        shelf->contents.addItem(i % 4, 5);
+        all.push_back(shelf);
+    }
+    for (int i = 0; i < 1000; i++) {
+        auto person = std::make_shared<Customer>();
+        person->position = glm::vec2{(i * 7) % 250, 2.f * (i % 200) + 1.f};
+        all.push_back(person);
+    }
+    for (auto& e : all) SpatialIndex::grid().insert(e);
+    QuadSink sink;
+
+    // 32 x 18 around the middle of the store
+    glm::mat4 projection = glm::ortho(-16.f, 16.f, -9.f, 9.f);
+    glm::mat4 view =
+        glm::translate(glm::mat4(1.f), glm::vec3{-125.f, -200.f, 0.f});
+    glm::vec4 onScreen = ViewCulling::visibleRect(view, projection);
+
+    // same as SuperLayer::render up to the renderer
+    double everything = bench_avg_us(frames, [&](int) {
+        for (auto& e : all) sink(*e);
+    });
+    double culled = bench_avg_us(frames, [&](int) {
+        ViewCulling::stats() = CullStats();
+        ViewCulling::forEachEntityIn(onScreen,
+                                     [&](const auto& e) { sink(*e); });
+    });
+    log_info(
+        "view culling: {} shelves + 1000 people, everything {:.0f}us, "
+        "on screen only {:.1f}us ({} drawn {} culled)",
+        numShelves, everything, culled, ViewCulling::stats().visible,
+        ViewCulling::stats().culled);
+
+    for (auto& e : all) SpatialIndex::grid().remove(e->id);
+}
+
+void all_benchmarks() {
+    bench_spatial_index();
+    bench_path_service();
+    bench_flow_field();
+    bench_path_hierarchy();
+    bench_job_queue();
+    bench_job_churn();
+    bench_job_assignment();
+    bench_entity_update();
+    bench_movement();
+    bench_item_group();
+    bench_stock_index();
+    bench_item_catalog();
+    bench_view_culling();
+    log_info("Finished running all benchmarks");
+}
@@ -3,6 +3,7 @@
 
 #include "job.h"
 #include "movable_entities.h"
+#include "spatial_index.h"
 
 struct Customer : public Person {
     float totalWallet;
@@ -38,14 +39,13 @@ struct Customer : public Person {
     void init() {
         // decide what to get
         // TODO maybe shouldnt be linear but normal distribution..
-        int numToGet = randIn(1, 1);
+        int numToGet = rng.range(1, 1);
         for (int i = 0; i < numToGet; i++) {
             shoppingList.addItem(
                 // itemid
-                // TODO probably dont use items_ directly...
-                randIn(0, items_.size() - 1),
+                rng.range(0, ItemManager::get().size() - 1),
                 // amount
-                randIn(1, 1));
+                rng.range(1, 1));
         }
 
         // decide how much money to bring
@@ -60,7 +60,7 @@ struct Customer : public Person {
 
     void scheduleFindItemJob(int itemID, int itemAmount) {
         auto shelves =
-            EntityHelper::getEntityInRangeWithItem<Shelf>(position, itemID, -1);
+            SpatialIndex::getEntityInRangeWithItem<Shelf>(position, itemID, -1);
         if (shelves.empty()) {
             announce(
                 fmt::format("tried to schedule a FindItem for {} but store "
@@ -74,18 +74,17 @@ struct Customer : public Person {
             "scheduling a job for myself, for item {} at shelf {}, ", itemID,
             shelfPos));
 
-        JobQueue::addJob(
-            JobType::FindItem,
-            std::make_shared<Job>(Job({.type = JobType::FindItem,
-                                       .reserved = id,
-                                       .startPosition = shelfPos,
-                                       .itemID = itemID,
-                                       .itemAmount = itemAmount})));
+        Intents::addJob(*this, JobType::FindItem,
+                        Job({.type = JobType::FindItem,
+                             .reserved = id,
+                             .startPosition = shelfPos,
+                             .itemID = itemID,
+                             .itemAmount = itemAmount}));
     }
 
     void estimateCartSpend() {
         float possibleSpend = 0;
-        auto im = GLOBALS.get<ItemManager>("item_manager");
+        const ItemManager& im = ItemManager::get();
         for (auto ig : shoppingList) {
             float global_price = im.get_avg_price(ig.first);
             float my_price = map_get_or_default(avgPricePaid, id, global_price);
@@ -130,7 +129,7 @@ struct Customer : public Person {
     // TODO move into Person() and use the same thing
     // for Employee
     bool grabFromNearbyShelf(int itemID, int itemAmount) {
-        auto shelves = EntityHelper::getEntityInRangeWithItem<Shelf>(
+        auto shelves = SpatialIndex::getEntityInRangeWithItem<Shelf>(
             position, itemID, REACH_DIST);
         if (shelves.empty()) {
             announce("no matching shelf");
@@ -139,54 +138,53 @@ struct Customer : public Person {
         }
         announce(fmt::format("trying to grab {} item{} from {}", itemAmount,
                              itemID, (*shelves.begin())->contents));
-        int amt = (*shelves.begin())->contents.removeItem(itemID, itemAmount);
-        shoppingCart.addItem(itemID, amt);
-        shoppingList.removeItem(itemID, amt);
+        // someone else might get there first, we find out once its applied
+        Intents::transfer(*this, (*shelves.begin())->contents, shoppingCart,
+                          itemID, itemAmount, [this, itemID](int amt) {
+                              shoppingList.removeItem(itemID, amt);
+                          });
         return true;
     }
 
-    bool workFindItem(const std::shared_ptr<Job>& j, WorkInput input) {
+    bool workFindItem(Job& j, WorkInput input) {
         (void)input;
         log_trace("workFindItem, ");
-        if (j->reg.find("amount") != j->reg.end()) {
-            j->reg["amount"] = 0;
-        }
-        switch (j->jobStatus) {
+        switch (j.jobStatus) {
             case 0:  // Just started the job
             {
                 // announce("walking to start");
                 // walk to start...
                 bool isAtStartLocation =
-                    walkToLocation(j->startPosition, input);
-                j->jobStatus = isAtStartLocation ? 1 : 0;
+                    walkToLocation(j.startPosition, input);
+                j.jobStatus = isAtStartLocation ? 1 : 0;
             } break;
             case 1:  // Reached start
             {
                 // announce("grab something");
-                bool success = grabFromNearbyShelf(j->itemID, j->itemAmount);
-                j->jobStatus = success ? 2 : -1;
+                bool success = grabFromNearbyShelf(j.itemID, j.itemAmount);
+                j.jobStatus = success ? 2 : -1;
             } break;
             case 2:  // Grabbed item
             {
                 // announce(fmt::format("finished finding item, {}, ",
-                // j->itemID));
-                j->isComplete = true;
+                // j.itemID));
+                j.isComplete = true;
                 return true;
             } break;
             case -1:  // Something bad happened...
             {
                 // log_warn("Something bad happened and i couldnt finish");
-                j->isComplete = true;
+                j.isComplete = true;
                 return true;
             } break;
         }
         return false;
     }
 
-    bool idleShop(const std::shared_ptr<Job>& j, WorkInput input) {
+    bool idleShop(Job& j, WorkInput input) {
         (void)input;
-        if (walkToLocation(j->endPosition, input)) {
-            j->isComplete = true;
+        if (walkToLocation(j.endPosition, input)) {
+            j.isComplete = true;
             return true;
         }
         return false;
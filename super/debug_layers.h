@@ -11,13 +11,19 @@
 #include "global.h"
 #include "job.h"
 #include "menu.h"
+#include "path_service.h"
+#include "text_cache.h"
+#include "view_culling.h"
 
-inline GLTtext* drawText(const std::string& content, int x, int y,
-                         float scale) {
-    GLTtext* text = gltCreateText();
-    gltSetText(text, content.c_str());
-    gltDrawText2D(text, x, y, scale);
-    return text;
+inline void drawText(const std::string& content, int x, int y, float scale) {
+    TextCache::get().draw2D(content, (float)x, (float)y, scale);
+}
+
+// for labels that read differently most frames (timings, counters), caching
+// those would just build a new mesh every frame and keep it around
+inline void drawChangingText(const std::string& content, int x, int y,
+                             float scale) {
+    TextCache::get().drawUncached(content, (float)x, (float)y, scale);
 }
 
 struct JobLayer : public Layer {
@@ -40,33 +46,26 @@ struct JobLayer : public Layer {
 
         int y = 10;
         float scale = 1.f;
-        gltInit();
-        gltBeginDraw();
+        TextCache::get().begin(this);
         gltColor(1.0f, 1.0f, 1.0f, 1.0f);
-        std::vector<GLTtext*> texts;
 
         // Job queue
-        texts.push_back(
-            drawText("Job Queue (highest pri to lowest) ", 0, y, scale));
+        drawText("Job Queue (highest pri to lowest) ", 0, y, scale);
         y += 30;
 
-        for (auto it = jobs.rbegin(); it != jobs.rend(); it++) {
-            auto [type, job_list] = *it;
-            int num_assigned = 0;
-            for (auto itt = job_list.begin(); itt != job_list.end(); itt++) {
-                if ((*itt)->isAssigned) num_assigned++;
-            }
+        for (int i = JobType::MAX_JOB_TYPE - 1; i >= 0; i--) {
+            JobType type = (JobType)i;
+            int num_jobs = JobQueue::numOfJobsWithType(type);
+            if (num_jobs == 0) continue;
             std::string t = fmt::format("{}: {} ({} assigned)",
-                                        jobTypeToString((JobType)type),
-                                        job_list.size(), num_assigned);
-            texts.push_back(drawText(t, 10, y, scale));
+                                        jobTypeToString(type), num_jobs,
+                                        JobQueue::numAssignedWithType(type));
+            drawText(t, 10, y, scale);
             y += 30;
         }
         // end job queue
 
-        gltEndDraw();
-        for (auto text : texts) gltDeleteText(text);
-        gltTerminate();
+        TextCache::get().end();
     }
 
     virtual void onEvent(Event& event) override {
@@ -105,10 +104,8 @@ struct ProfileLayer : public Layer {
 
         int y = 40;
         float scale = 1.f;
-        gltInit();
-        gltBeginDraw();
+        TextCache::get().begin(this);
         gltColor(1.0f, 1.0f, 1.0f, 1.0f);
-        std::vector<GLTtext*> texts;
 
         std::vector<SamplePair> pairs;
         pairs.insert(pairs.end(), profiler__DO_NOT_USE._acc.begin(),
@@ -120,23 +117,44 @@ struct ProfileLayer : public Layer {
 
         for (const auto& x : pairs) {
             auto stats = x.second;
-            texts.push_back(
-                drawText(fmt::format("{}{}: avg: {:.2f}ms",
-                                     showFilenames ? stats.filename : "",
-                                     x.first, stats.average()),
-                         WIN_W - 520, y, scale));
+            drawChangingText(
+                fmt::format("{}{}: avg: {:.2f}ms",
+                            showFilenames ? stats.filename : "", x.first,
+                            stats.average()),
+                WIN_W - 520, y, scale);
             y += 30;
         }
 
-        texts.push_back(
-            drawText(fmt::format("Press delete to toggle filenames {}",
-                                 showFilenames ? "off" : "on"),
-                     0, y, scale));
+        const PathCache& pathCache = PathService::get().cache;
+        drawChangingText(
+            fmt::format("path cache: {:.0f}% hits ({}/{}) size: {}",
+                        pathCache.hitRate() * 100.f, pathCache.hits,
+                        pathCache.hits + pathCache.misses, pathCache.size()),
+            WIN_W - 520, y, scale);
+        y += 30;
+        drawChangingText(fmt::format("path cache: {} evicted {} invalidated",
+                                     pathCache.evicted, pathCache.invalidated),
+                         WIN_W - 520, y, scale);
+        y += 30;
+
+        const CullStats& culled = ViewCulling::stats();
+        drawChangingText(fmt::format("drawn: {} on screen {} culled",
+                                     culled.visible, culled.culled),
+                         WIN_W - 520, y, scale);
         y += 30;
 
-        gltEndDraw();
-        for (auto text : texts) gltDeleteText(text);
-        gltTerminate();
+        const auto& meshes = TextCache::get().meshes;
+        drawChangingText(fmt::format("text cache: {} strings {} built",
+                                     meshes.entries.size(), meshes.misses),
+                         WIN_W - 520, y, scale);
+        y += 30;
+
+        drawText(fmt::format("Press delete to toggle filenames {}",
+                             showFilenames ? "off" : "on"),
+                 0, y, scale);
+        y += 30;
+
+        TextCache::get().end();
     }
 
     bool onKeyPressed(KeyPressedEvent event) {
@@ -149,6 +167,8 @@ struct ProfileLayer : public Layer {
             }
             if (event.keycode == Key::getMapping("Profiler Clear Stats")) {
                 profiler__DO_NOT_USE._acc.clear();
+                PathService::get().cache.resetStats();
+                TextCache::get().meshes.misses = 0;
             }
         }
         // log_info(std::to_string(event.keycode));
@@ -164,6 +184,7 @@ struct ProfileLayer : public Layer {
 
 struct EntityDebugLayer : public Layer {
     std::shared_ptr<Entity> node;
+    std::string label;
 
     EntityDebugLayer() : Layer("EntityDebug") {
         isMinimized = false;  //! IS_DEBUG;
@@ -198,18 +219,23 @@ struct EntityDebugLayer : public Layer {
 
         prof give_me_a_name(__PROFILE_FUNC__);
 
-        gltInit();
+        // only label whats on screen
+        glm::vec4 onScreen =
+            ViewCulling::visibleRect(cameraController->camera.view,
+                                     cameraController->camera.projection);
+
         float scale = 0.003f;
-        std::vector<GLTtext*> texts;
         gltColor(1.0f, 1.0f, 1.0f, 1.0f);
-        gltBeginDraw();
+        TextCache::get().begin(this);
 
         std::vector<std::shared_ptr<MovableEntity>> movables;
 
-        EntityHelper::forEachEntity([&](auto e) {
-            auto s = fmt::format("{}", *e);
-            GLTtext* text = gltCreateText();
-            gltSetText(text, s.c_str());
+        SpatialIndex::grid().forEachInRect(onScreen, [&](const auto& e) {
+            // formatted into the same buffer every time, the cache only
+            // builds a mesh if the label reads differently than before
+            label.clear();
+            fmt::format_to(std::back_inserter(label), "{}", *e);
+            GLTtext* text = TextCache::get().text(label);
 
             // V = C^-1
             auto V = cameraController->camera.view;
@@ -227,7 +253,6 @@ struct EntityDebugLayer : public Layer {
             auto mvp = P * V * M;
 
             gltDrawText(text, glm::value_ptr(mvp));
-            texts.push_back(text);
 
             auto m = dynamic_pointer_cast<MovableEntity>(e);
             if (m && !m->path.empty()) {
@@ -236,9 +261,7 @@ struct EntityDebugLayer : public Layer {
             return EntityHelper::ForEachFlow::None;
         });
 
-        gltEndDraw();
-        for (auto text : texts) gltDeleteText(text);
-        gltTerminate();
+        TextCache::get().end();
 
         Renderer::begin(cameraController->camera);
 
@@ -250,7 +273,7 @@ struct EntityDebugLayer : public Layer {
             }
         }
 
-        EntityHelper::forEachEntity([&](auto e) {
+        SpatialIndex::grid().forEachInRect(onScreen, [&](const auto& e) {
             auto [a, b, c, d] = getBoundingBox(e->position, e->size);
             node->position = a;
             node->render();
@@ -264,8 +287,11 @@ struct EntityDebugLayer : public Layer {
         });
 
         for (auto& m : movables) {
-            for (auto it = m->path.begin(); it != m->path.end(); it++) {
-                node->position = *it;
+            for (int i = 0; i < m->path.size(); i++) {
+                const glm::vec2& point = m->path[i];
+                if (!ViewCulling::overlaps(onScreen, point, glm::vec2{0.f}))
+                    continue;
+                node->position = point;
                 node->render();
             }
         }
@@ -5,12 +5,17 @@
 #include "../vendor/supermarket-engine/engine/pch.hpp"
 #include "../vendor/supermarket-engine/engine/ui.h"
 #include "movable_entities.h"
+#include "spatial_index.h"
+#include "textures.h"
+#include "view_culling.h"
 
 struct DragArea : public Entity {
     bool isMouseDragging = false;
     glm::vec2 mouseDragStart;
     glm::vec2 mouseDragEnd;
     int tool = 0;
+    // what the tool puts down, Textures::White for none
+    TextureHandle placing = Textures::White;
 
     std::vector<std::shared_ptr<Entity>> selected;
 
@@ -24,9 +29,9 @@ struct DragArea : public Entity {
     virtual ~DragArea() {}
     virtual const char* typeString() const override { return "DragArea"; }
 
-    void place(int selectedTool, std::string object) {
+    void place(int selectedTool, TextureHandle object) {
         tool = selectedTool;
-        textureName = object;
+        placing = object;
     }
 
     virtual void onUpdate(Time dt) override {
@@ -50,7 +55,7 @@ struct DragArea : public Entity {
         mouseDragStart = glm::vec2{0.f};
         mouseDragEnd = glm::vec2{0.f};
         tool = 0;
-        textureName = "white";
+        placing = Textures::White;
     }
 
     void onDragStart(glm::vec3 mouse) {
@@ -62,18 +67,18 @@ struct DragArea : public Entity {
     void onDragEnd() {
         if (tool != 0 && tool != 3) {
             if (0) {
-            } else if (textureName == "shelf") {
+            } else if (placing == Textures::Shelf) {
                 forEachPlaced(false, [](glm::vec2 pos) {
-                    if (EntityHelper::entityInLocation(pos, glm::vec2{0.5f}))
+                    if (SpatialIndex::entityInLocation(pos, glm::vec2{0.5f}))
                         return;
-                    EntityHelper::addEntity(std::make_shared<Shelf>(Shelf(
+                    SpatialIndex::addEntity(std::make_shared<Shelf>(Shelf(
                         pos, glm::vec2{1.f}, 0.f, glm::vec4{1.f}, "shelf")));
                 });
-            } else if (textureName == "box") {
+            } else if (placing == Textures::Box) {
                 forEachPlaced(false, [](glm::vec2 pos) {
-                    if (EntityHelper::entityInLocation(pos, glm::vec2{0.5f}))
+                    if (SpatialIndex::entityInLocation(pos, glm::vec2{0.5f}))
                         return;
-                    EntityHelper::addEntity(std::make_shared<Storage>(Storage(
+                    SpatialIndex::addEntity(std::make_shared<Storage>(Storage(
                         pos, glm::vec2{1.f}, 0.f, glm::vec4{1.f}, "box")));
                 });
             }
@@ -103,7 +108,7 @@ struct DragArea : public Entity {
         } else if (a.x >= b.x && a.y <= b.y) {
             rect = glm::vec4{b.x, a.y, a.x, b.y};
         }
-        selected = EntityHelper::getEntityInSelection<Entity>(rect);
+        selected = SpatialIndex::getEntityInSelection<Entity>(rect);
 
         if (tool == 3) {
             delete_selected();
@@ -129,7 +134,8 @@ struct DragArea : public Entity {
     }
 
     virtual void render(const RenderOptions& = RenderOptions()) override {
-        if (textureName == "white") {
+        const std::string& texture = Textures::name(placing);
+        if (placing == Textures::White) {
             // dont draw if we are 0 size
             if (size.x == 0 && size.y == 0) return;
 
@@ -137,7 +143,7 @@ struct DragArea : public Entity {
             if (center) {
                 loc = loc + glm::vec2{size.x / 2, size.y / 2};
             }
-            Renderer::drawQuad(loc, size, color, textureName);
+            Renderer::drawQuad(loc, size, color, texture);
             return;
         }
 
@@ -148,7 +154,7 @@ struct DragArea : public Entity {
                 pos,             //
                 glm::vec2{1.f},  //
                 color,           //
-                textureName      //
+                texture          //
             );
         });
     }
@@ -159,9 +165,13 @@ struct DragArea : public Entity {
         }
     }
 
-    void render_selected() {
+    // onScreen is from ViewCulling::visibleRect
+    void render_selected(const glm::vec4& onScreen) {
         // TODO should we just do "selected" in renderoptions directly
         for (auto& entity : selected) {
+            if (!ViewCulling::overlaps(onScreen, entity->position,
+                                       entity->size))
+                continue;
             entity->render(RenderOptions({
                 .position = entity->position + (0.5f * glm::vec2{entity->size}),
                 .color = std::make_optional(IUI::teal),
@@ -0,0 +1,200 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/entity.h"
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "item.h"
+#include "job.h"
+#include "thread_pool.h"
+
+// Entities update in two phases so the update can run on every core.
+//
+// Think: every entity's onUpdate runs in parallel. The world is frozen, the
+// only thing an entity writes is its own state, anything that touches
+// someone else (moving, taking items off a shelf, adding or finishing a
+// job, asking the PathService for a path) goes through Intents instead.
+//
+// Apply: back on the main thread the intents run one by one in entity
+// order, so the result is the same no matter how many threads there are or
+// which one got to what first. Two customers going for the last can of
+// beans both get to ask but only the first one in line gets it.
+
+enum class IntentType {
+    Move,
+    Transfer,
+    AddJob,
+    CompleteJob,
+    RequestJob,
+    // anything that can only run on the main thread (path requests etc)
+    Deferred,
+};
+
+struct Intent {
+    IntentType type;
+    Entity* entity = nullptr;
+    // Move: where to, RequestJob: where we are
+    glm::vec2 position;
+    // Transfer: move up to amount of itemID from one group to another
+    ItemGroup* from = nullptr;
+    ItemGroup* to = nullptr;
+    int itemID = 0;
+    int amount = 0;
+    // CompleteJob
+    JobHandle job;
+    // RequestJob
+    JobRange range;
+    // AddJob, index into IntentBuffer::jobs
+    int jobIndex = -1;
+    // Transfer: called with the amount that actually moved, Deferred: the
+    // work itself (called with 0)
+    std::function<void(int)> done;
+};
+
+// Intents from one chunk of entities, in the order they were made
+struct IntentBuffer {
+    std::vector<Intent> intents;
+    // AddJob payloads, kept out of Intent so moves stay small
+    std::vector<Job> jobs;
+
+    void clear() {
+        intents.clear();
+        jobs.clear();
+    }
+};
+
+// where the current thread is collecting intents, nullptr outside of the
+// think phase
+static thread_local IntentBuffer* intentBuffer_DO_NOT_USE = nullptr;
+
+// What entities call during onUpdate. Outside of EntityUpdater (tests,
+// menus) there is no buffer and the intent is applied right away
+struct Intents {
+    static IntentBuffer*& current() { return intentBuffer_DO_NOT_USE; }
+
+    static void emit(Intent&& intent) {
+        if (!current()) {
+            apply(intent, nullptr);
+            return;
+        }
+        current()->intents.push_back(std::move(intent));
+    }
+
+    static void move(Entity& e, const glm::vec2& position) {
+        emit(Intent{.type = IntentType::Move,
+                    .entity = &e,
+                    .position = position});
+    }
+
+    static void transfer(Entity& e, ItemGroup& from, ItemGroup& to,
+                         int itemID, int amount,
+                         std::function<void(int)> done = nullptr) {
+        emit(Intent{.type = IntentType::Transfer,
+                    .entity = &e,
+                    .from = &from,
+                    .to = &to,
+                    .itemID = itemID,
+                    .amount = amount,
+                    .done = std::move(done)});
+    }
+
+    static void addJob(Entity& e, JobType type, const Job& job) {
+        if (!current()) {
+            JobQueue::addJob(type, job);
+            return;
+        }
+        current()->jobs.push_back(job);
+        current()->jobs.back().type = type;
+        emit(Intent{.type = IntentType::AddJob,
+                    .entity = &e,
+                    .jobIndex = (int)current()->jobs.size() - 1});
+    }
+
+    static void completeJob(Entity& e, JobHandle job) {
+        emit(Intent{.type = IntentType::CompleteJob,
+                    .entity = &e,
+                    .job = job});
+    }
+
+    static void requestJob(Entity& e, const glm::vec2& position,
+                           JobRange range) {
+        emit(Intent{.type = IntentType::RequestJob,
+                    .entity = &e,
+                    .position = position,
+                    .range = range});
+    }
+
+    static void later(Entity& e, std::function<void(int)> fn) {
+        emit(Intent{.type = IntentType::Deferred,
+                    .entity = &e,
+                    .done = std::move(fn)});
+    }
+
+    static void apply(Intent& intent, IntentBuffer* buffer) {
+        switch (intent.type) {
+            case IntentType::Move:
+                intent.entity->position = intent.position;
+                break;
+            case IntentType::Transfer: {
+                // whoever was first already took their share
+                int amount = std::min(intent.amount,
+                                      intent.from->count(intent.itemID));
+                if (amount > 0) {
+                    intent.from->removeItem(intent.itemID, amount);
+                    intent.to->addItem(intent.itemID, amount);
+                }
+                if (intent.done) intent.done(amount);
+            } break;
+            case IntentType::AddJob: {
+                const Job& job = buffer->jobs[intent.jobIndex];
+                JobQueue::addJob(job.type, job);
+            } break;
+            case IntentType::CompleteJob:
+                JobQueue::complete(intent.job);
+                break;
+            case IntentType::RequestJob:
+                JobAssigner::get().request(intent.entity->id, intent.position,
+                                           intent.range);
+                break;
+            case IntentType::Deferred:
+                intent.done(0);
+                break;
+        }
+    }
+
+    static void apply(IntentBuffer& buffer) {
+        for (Intent& intent : buffer.intents) apply(intent, &buffer);
+        buffer.clear();
+    }
+};
+
+// Runs the think phase over a ThreadPool and then applies the intents
+struct EntityUpdater {
+    // entities per task, small enough that a chunk full of busy agents
+    // doesnt leave the other threads waiting at the end
+    static constexpr int CHUNK = 32;
+
+    ThreadPool pool;
+    // one per chunk, reused every frame
+    std::vector<IntentBuffer> buffers;
+
+    inline static EntityUpdater& get() {
+        static EntityUpdater updater;
+        return updater;
+    }
+
+    void update(const std::vector<std::shared_ptr<Entity>>& entities,
+                Time dt) {
+        int numChunks = ((int)entities.size() + CHUNK - 1) / CHUNK;
+        if ((int)buffers.size() < numChunks) buffers.resize(numChunks);
+
+        pool.parallelFor(numChunks, [&](int c) {
+            Intents::current() = &buffers[c];
+            int end = std::min((int)entities.size(), (c + 1) * CHUNK);
+            for (int i = c * CHUNK; i < end; i++) entities[i]->onUpdate(dt);
+            Intents::current() = nullptr;
+        });
+
+        // chunks are in entity order so this is too
+        for (int c = 0; c < numChunks; c++) Intents::apply(buffers[c]);
+    }
+};
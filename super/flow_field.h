@@ -0,0 +1,288 @@
+
+#pragma once
+
+#include <list>
+#include <queue>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "occupancy_grid.h"
+#include "path_cache.h"
+#include "path_service.h"
+
+// One search from the goal outwards that every agent heading there can
+// share. The integration field holds the cost to reach the goal from each
+// cell and the direction field which neighbor to step to next, so following
+// it is a lookup per tick instead of a path search per agent.
+//
+// Cells are `stride` occupancy sub tiles wide and only count as free if all
+// of their sub tiles are. Blocked cells arent impossible, just very
+// expensive, since the goal itself is usually inside a shelf / storage box
+struct FlowField {
+    static constexpr float BLOCKED_COST = 1000.f;
+    static constexpr int8_t NO_DIRECTION = -1;
+    // 4 straight then 4 diagonal, opposites are next to each other so
+    // the way back is always i ^ 1
+    static constexpr int NEIGHBORS[8][2] = {
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1},
+    };
+
+    glm::vec2 goal;
+    float cellSize = 0.f;
+    // in field cells
+    int originX = 0;
+    int originY = 0;
+    int width = 0;
+    int height = 0;
+
+    std::vector<float> cost;
+    std::vector<int8_t> dir;
+
+    bool empty() const { return width == 0; }
+
+    int toCell(float v) const { return (int)std::floor(v / cellSize); }
+
+    int indexOf(const glm::vec2& pos) const {
+        int x = toCell(pos.x) - originX;
+        int y = toCell(pos.y) - originY;
+        if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+        return y * width + x;
+    }
+
+    glm::vec2 centerOf(int index) const {
+        return glm::vec2{(originX + index % width) + 0.5f,
+                         (originY + index / width) + 0.5f} *
+               cellSize;
+    }
+
+    // Where to walk towards from pos, follows the direction field until it
+    // turns (or `lookahead` cells) so the agent moves in straight runs.
+    // Returns location once we reach the goal cell, nullopt if pos is
+    // outside of the field
+    std::optional<glm::vec2> target(const glm::vec2& pos,
+                                    const glm::vec2& location,
+                                    int lookahead = 8) const {
+        int index = indexOf(pos);
+        if (index < 0) return {};
+        int8_t d = dir[index];
+        if (d == NO_DIRECTION) return location;
+
+        for (int i = 0; i < lookahead; i++) {
+            int next = index + NEIGHBORS[d][0] + NEIGHBORS[d][1] * width;
+            if (dir[next] == NO_DIRECTION) return location;
+            index = next;
+            if (dir[index] != d) break;
+        }
+        return centerOf(index);
+    }
+
+    static FlowField build(const OccupancyGrid& grid,
+                           const OccupancyGrid::Layer& layer,
+                           const glm::vec2& goal, int stride = 2) {
+        FlowField field;
+        field.goal = goal;
+        field.cellSize = grid.resolution * stride;
+        if (grid.width == 0) return field;
+
+        field.originX = (int)std::floor((float)grid.originX / stride);
+        field.originY = (int)std::floor((float)grid.originY / stride);
+        field.width = (int)std::ceil((float)grid.width / stride) + 1;
+        field.height = (int)std::ceil((float)grid.height / stride) + 1;
+
+        int goalIndex = field.indexOf(goal);
+        if (goalIndex < 0) {
+            field.width = field.height = 0;
+            return field;
+        }
+
+        size_t n = (size_t)field.width * field.height;
+        std::vector<float> factor(n, 1.f);
+        for (int y = 0; y < field.height; y++) {
+            for (int x = 0; x < field.width; x++) {
+                bool blocked = false;
+                for (int sy = 0; sy < stride && !blocked; sy++) {
+                    for (int sx = 0; sx < stride && !blocked; sx++) {
+                        glm::vec2 p = glm::vec2{
+                            (field.originX + x) * stride + sx + 0.5f,
+                            (field.originY + y) * stride + sy + 0.5f,
+                        };
+                        blocked = grid.test(layer, p * grid.resolution);
+                    }
+                }
+                if (blocked) factor[y * field.width + x] = BLOCKED_COST;
+            }
+        }
+
+        field.cost.assign(n, std::numeric_limits<float>::max());
+        field.dir.assign(n, NO_DIRECTION);
+
+        // dijkstra out from the goal
+        typedef std::pair<float, int> Item;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+        field.cost[goalIndex] = 0.f;
+        open.push({0.f, goalIndex});
+        while (!open.empty()) {
+            auto [c, index] = open.top();
+            open.pop();
+            if (c > field.cost[index]) continue;
+            int x = index % field.width;
+            int y = index / field.width;
+            for (int i = 0; i < 8; i++) {
+                int nx = x + NEIGHBORS[i][0];
+                int ny = y + NEIGHBORS[i][1];
+                if (nx < 0 || ny < 0 || nx >= field.width ||
+                    ny >= field.height)
+                    continue;
+                int next = ny * field.width + nx;
+                float step = factor[next];
+                if (i >= 4) {
+                    // dont cut corners, diagonals pay for both sides
+                    step = std::max({step, factor[y * field.width + nx],
+                                     factor[ny * field.width + x]}) *
+                           1.41421f;
+                }
+                if (c + step < field.cost[next]) {
+                    field.cost[next] = c + step;
+                    // we got here from index, so walk back the same way
+                    field.dir[next] = (int8_t)(i ^ 1);
+                    open.push({c + step, next});
+                }
+            }
+        }
+        return field;
+    }
+};
+
+// Keeps flow fields for the destinations lots of agents are walking to (the
+// storage box for Fill jobs, popular shelves) and leaves one off targets
+// like DirectedWalk to the path search
+struct FlowFieldCache {
+    // number of path requests to the same spot before it gets a field
+    static constexpr int HOT_THRESHOLD = 4;
+    static constexpr size_t MAX_FIELDS = 32;
+    // forget request counts after this many distinct destinations
+    static constexpr size_t MAX_TRACKED = 4096;
+
+    struct Entry {
+        PathKey key;
+        FlowField field;
+        // update() tick this was last found at, agents look fields up from
+        // the think phase so this is all find() gets to write
+        std::atomic<int> lastUsed;
+
+        Entry(const PathKey& k, FlowField&& f, int tick)
+            : key(k), field(std::move(f)), lastUsed(tick) {}
+    };
+
+    // building a field for a big store takes a while so it happens on the
+    // PathService workers, agents keep using paths until it lands
+    struct Build {
+        PathKey key;
+        // OccupancyGrid::version the snapshot was taken at
+        int version;
+        std::shared_ptr<const OccupancyGrid> grid;
+        FlowField field;
+        std::atomic<bool> done{false};
+    };
+
+    std::list<Entry> fields;
+    std::unordered_map<PathKey, std::list<Entry>::iterator, PathKeyHash>
+        lookup;
+    std::unordered_map<PathKey, int, PathKeyHash> requests;
+    std::unordered_map<PathKey, std::shared_ptr<Build>, PathKeyHash> building;
+    int built = 0;
+    int tick = 0;
+
+    inline static FlowFieldCache& get() {
+        static FlowFieldCache cache;
+        return cache;
+    }
+
+    static PathKey keyFor(const glm::vec2& end, const glm::vec2& size) {
+        // start doesnt matter for a field
+        return PathCache::keyFor(glm::vec2{0.f}, end, size);
+    }
+
+    // Safe to call from the think phase (see EntityUpdater)
+    const FlowField* find(const glm::vec2& end, const glm::vec2& size) {
+        auto it = lookup.find(keyFor(end, size));
+        if (it == lookup.end()) return nullptr;
+        it->second->lastUsed.store(tick, std::memory_order_relaxed);
+        return &it->second->field;
+    }
+
+    // Called for every path request, builds a field once enough agents
+    // want to go to the same place
+    void noteRequest(const glm::vec2& end, const glm::vec2& size) {
+        PathKey key = keyFor(end, size);
+        if (lookup.find(key) != lookup.end()) return;
+        if (building.find(key) != building.end()) return;
+
+        if (requests.size() > MAX_TRACKED) requests.clear();
+        if (++requests[key] < HOT_THRESHOLD) return;
+
+        auto b = std::make_shared<Build>();
+        b->key = key;
+        b->grid = PathService::get().snapshotFor(size);
+        b->version = b->grid->version;
+        building[key] = b;
+
+        PathService::get().run([b, end, size]() {
+            auto start = std::chrono::high_resolution_clock::now();
+            b->field =
+                FlowField::build(*b->grid, *b->grid->findLayer(size), end);
+            auto took = std::chrono::high_resolution_clock::now() - start;
+            // counts as path searching time
+            PathService::get().searchNanos +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(took)
+                    .count();
+            b->grid.reset();
+            b->done.store(true, std::memory_order_release);
+        });
+    }
+
+    // Moves finished builds into the cache, call once a frame from the
+    // main thread
+    void update() {
+        int liveVersion = Occupancy::grid().version;
+        auto it = building.begin();
+        while (it != building.end()) {
+            Build& b = *it->second;
+            if (!b.done.load(std::memory_order_acquire)) {
+                it++;
+                continue;
+            }
+            // layout changed while we were building, the next request
+            // will start over
+            if (b.version == liveVersion && !b.field.empty()) {
+                fields.emplace_front(b.key, std::move(b.field), tick);
+                lookup[b.key] = fields.begin();
+                built++;
+            }
+            it = building.erase(it);
+        }
+
+        // drop whatever nobody has followed for the longest, on a tie the
+        // one that landed first
+        while (fields.size() > MAX_FIELDS) {
+            auto oldest = fields.begin();
+            for (auto f = fields.begin(); f != fields.end(); f++) {
+                if (f->lastUsed <= oldest->lastUsed) oldest = f;
+            }
+            lookup.erase(oldest->key);
+            fields.erase(oldest);
+        }
+        tick++;
+    }
+
+    void clear() {
+        fields.clear();
+        lookup.clear();
+    }
+
+    // Registered with SpatialIndex::addLayoutListener. Fields cover the
+    // whole store so any change means rebuilding, which happens the next
+    // time someone asks for a path to a hot destination
+    static void onLayoutChanged(const std::shared_ptr<Entity>&, bool) {
+        get().clear();
+    }
+};
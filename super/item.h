@@ -4,9 +4,16 @@
 #include "../vendor/supermarket-engine/engine/entity.h"
 #include "../vendor/supermarket-engine/engine/pch.hpp"
 #include "../vendor/supermarket-engine/engine/renderer.h"
+#include "small_vector.h"
+#include "textures.h"
 //
+#include <cerrno>
+#include <fstream>
 #include <memory>
+#include <sstream>
 
+// What an item looks like in the data file, also used for the built in
+// defaults below
 struct Item {
     const char* name;
     float price;
@@ -18,42 +25,150 @@ struct Item {
         : name(n), price(p), textureName(t), color(c) {}
 };
 
-// error: excess items in array initializer
-//             number of items should match       V
-static constexpr std::array<std::pair<int, Item>, 4> items_{
-    //
-    {
-        {0, {"egg", 1.f, "egg", glm::vec4{1.f}}},                    //
-        {1, {"milk", 1.f, "milk", glm::vec4{1.f}}},                  //
-        {2, {"peanutbutter", 1.f, "peanutbutter", glm::vec4{1.f}}},  //
-        {3, {"pizza", 1.f, "pizza", glm::vec4{1.f}}},                //
-    }
-    //
-};
-
+// only used if resources/items.csv cant be read (like when running headless
+// from somewhere else)
+static constexpr std::array<Item, 4> defaultItems_{{
+    {"egg", 1.f, "egg", glm::vec4{1.f}},
+    {"milk", 1.f, "milk", glm::vec4{1.f}},
+    {"peanutbutter", 1.f, "peanutbutter", glm::vec4{1.f}},
+    {"pizza", 1.f, "pizza", glm::vec4{1.f}},
+}};
+
+// The catalog. Ids are dense from 0 so everything about an item is one
+// array lookup per field, and there is only ever the one copy, get it by
+// reference with ItemManager::get().
+//
+// Loaded from resources/items.csv, one item per line, line number is the id:
+//     name,price,texture[,r,g,b,a]
 struct ItemManager {
-    std::map<int, float> priceEstimateAvg;
-    std::map<int, int> priceEstimateCount;
-    std::map<int, std::shared_ptr<Item>> items;
+    static constexpr const char* DEFAULT_FILE = "./resources/items.csv";
+
+    std::vector<std::string> names;
+    std::vector<float> prices;
+    std::vector<float> priceEstimateAvg;
+    std::vector<int> priceEstimateCount;
+    std::vector<glm::vec4> colors;
+    // thousands of items share a handful of textures
+    std::vector<TextureHandle> textures;
     int longestName = 0;
 
     ItemManager() {
-        init_items();
+        if (!load(DEFAULT_FILE)) loadDefaults();
         GLOBALS.set("item_manager", this);
     }
 
-    void init_items() {
-        // TODO read from a file;
-        for (auto it : items_) {
-            items[it.first] = std::make_shared<Item>(it.second);
-            int nlen = (int)strlen(it.second.name);
-            if (nlen > longestName) longestName = nlen;
-            priceEstimateAvg[it.first] = it.second.price;
-            priceEstimateCount[it.first] = 1;
+    // never destroyed, shelves in the global entity list can still render
+    // or price things at exit
+    inline static ItemManager& get() {
+        static ItemManager* manager = new ItemManager();
+        return *manager;
+    }
+
+    void clear() {
+        names.clear();
+        prices.clear();
+        priceEstimateAvg.clear();
+        priceEstimateCount.clear();
+        colors.clear();
+        textures.clear();
+        longestName = 0;
+    }
+
+    int add(const std::string& name, float price, const std::string& texture,
+            const glm::vec4& color = glm::vec4{1.f}) {
+        names.push_back(name);
+        prices.push_back(price);
+        priceEstimateAvg.push_back(price);
+        priceEstimateCount.push_back(1);
+        colors.push_back(color);
+        textures.push_back(Textures::handle(texture));
+        longestName = std::max(longestName, (int)name.size());
+        return size() - 1;
+    }
+
+    void loadDefaults() {
+        clear();
+        for (const Item& item : defaultItems_) {
+            add(item.name, item.price, item.textureName, item.color);
+        }
+    }
+
+    bool load(const std::string& filename) {
+        std::ifstream file(filename);
+        if (!file) return false;
+        return load(file) > 0;
+    }
+
+    // whole field has to be a number, unlike std::stof this doesnt throw
+    static bool parseFloat(const std::string& field, float& out) {
+        if (field.empty()) return false;
+        char* end = nullptr;
+        errno = 0;
+        out = std::strtof(field.c_str(), &end);
+        return errno == 0 && end == field.c_str() + field.size();
+    }
+
+    // Replaces the catalog, returns how many items were read. Bad lines
+    // are skipped (and logged) so ids after them move up one
+    int load(std::istream& in) {
+        clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            // files saved on windows
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            std::vector<std::string> fields;
+            std::stringstream ss(line);
+            std::string field;
+            while (std::getline(ss, field, ',')) fields.push_back(field);
+            if (fields.size() != 3 && fields.size() != 7) {
+                log_warn("skipping item line \"{}\"", line);
+                continue;
+            }
+            float price = 0.f;
+            glm::vec4 color{1.f};
+            bool ok = parseFloat(fields[1], price);
+            for (int i = 0; ok && i < (int)fields.size() - 3; i++) {
+                ok = parseFloat(fields[3 + i], color[i]);
+            }
+            if (!ok) {
+                log_warn("skipping item line \"{}\", bad number", line);
+                continue;
+            }
+            add(fields[0], price, fields[2], color);
+        }
+        return size();
+    }
+
+    // Pads the catalog out to count items by cycling through the real ones,
+    // for stress testing stores with way more products than we have art for
+    void generate(int count) {
+        int real = size();
+        if (real == 0 || count <= real) return;
+        // add() is passed our own strings, they cant move while it runs
+        names.reserve(count);
+        prices.reserve(count);
+        priceEstimateAvg.reserve(count);
+        priceEstimateCount.reserve(count);
+        colors.reserve(count);
+        textures.reserve(count);
+        for (int id = real; id < count; id++) {
+            int base = id % real;
+            add(names[base], prices[base], Textures::name(textures[base]),
+                colors[base]);
         }
     }
 
-    void update_price(int id, float p) { items[id]->price = p; }
+    int size() const { return (int)names.size(); }
+
+    const std::string& name(int id) const { return names[id]; }
+    float price(int id) const { return prices[id]; }
+    const glm::vec4& color(int id) const { return colors[id]; }
+    const std::string& textureName(int id) const {
+        return Textures::name(textures[id]);
+    }
+
+    void update_price(int id, float p) { prices[id] = p; }
 
     // Note: Updated on purchase, not setting
     void update_average(int id, float p) {
@@ -66,58 +181,251 @@ struct ItemManager {
         priceEstimateCount[id] = n + 1;
     }
 
-    float get_avg_price(int id) { return priceEstimateAvg[id]; }
+    float get_avg_price(int id) const { return priceEstimateAvg[id]; }
+};
+
+// Where a tracked ItemGroup lives, see InventoryLedger
+enum class ItemLocation {
+    None,
+    Shelf,
+    Storage,
+    Employee,
+    MAX,
+};
+
+// Running totals of every item in the store, kept up to date by the
+// ItemGroups themselves (anything with a location other than None reports
+// every add and remove) so reading a total is just an array lookup instead
+// of walking every shelf and employee. Main thread only, which is where
+// item transfers get applied anyway (see Intents)
+struct InventoryLedger {
+    // [location][item id]
+    std::array<std::vector<int>, (int)ItemLocation::MAX> counts;
+    std::vector<int> totals;
+
+    // never destroyed, shelves in the global entity list still report
+    // their contents on the way out at exit
+    inline static InventoryLedger& get() {
+        static InventoryLedger* ledger = new InventoryLedger();
+        return *ledger;
+    }
+
+    void note(ItemLocation where, int id, int delta) {
+        if (where == ItemLocation::None || delta == 0) return;
+        if (id >= (int)totals.size()) {
+            totals.resize(id + 1, 0);
+            for (auto& c : counts) c.resize(id + 1, 0);
+        }
+        counts[(int)where][id] += delta;
+        totals[id] += delta;
+    }
+
+    // everything in the store
+    int total(int id) const {
+        return id >= 0 && id < (int)totals.size() ? totals[id] : 0;
+    }
+
+    int total(int id, ItemLocation where) const {
+        const std::vector<int>& c = counts[(int)where];
+        return id >= 0 && id < (int)c.size() ? c[id] : 0;
+    }
 
-    Item& get(int id) { return *items.at(id); }
-    std::shared_ptr<Item> get_ptr(int id) { return items.at(id); }
+    // ids at or past this have never been seen
+    int numItems() const { return (int)totals.size(); }
 };
 
-[[deprecated]] static ItemManager itemManager_DO_NOT_USE_DIRECTLY;
+struct ItemGroup;
+// Tells the StockIndex an id showed up in (or is gone from) a shelf or
+// storage box, defined down there once Storable is
+inline void noteStockEntry(const ItemGroup* group, int id, bool added);
+
+// id and amount, named like a map entry so loops over an ItemGroup read the
+// same as they did when it was a std::map
+struct ItemCount {
+    int first;
+    int second;
+};
 
+// Sorted (by id) flat map of id -> amount. Almost every group holds one to
+// four ids so those live inline and a group only allocates past that
 struct ItemGroup {
-    std::map<int, int> group;
+    static constexpr int INLINE = 4;
+    SmallVector<ItemCount, INLINE> group;
+    // anything but None reports changes to the InventoryLedger
+    ItemLocation location = ItemLocation::None;
+
+    ItemGroup() {}
+    explicit ItemGroup(ItemLocation where) : location(where) {}
+    // a copy is a new place holding the same things, so those count too
+    ItemGroup(const ItemGroup& other)
+        : group(other.group), location(other.location) {
+        noteAll(1);
+    }
+    ItemGroup(ItemGroup&& other)
+        : group(std::move(other.group)), location(other.location) {}
+    ~ItemGroup() { noteAll(-1); }
+
+    // keeps our own location
+    ItemGroup& operator=(const ItemGroup& other) {
+        if (this == &other) return *this;
+        noteAll(-1);
+        group = other.group;
+        noteAll(1);
+        return *this;
+    }
+    ItemGroup& operator=(ItemGroup&& other) {
+        if (this == &other) return *this;
+        noteAll(-1);
+        // they are leaving wherever other is and coming here
+        other.noteAll(-1);
+        group = std::move(other.group);
+        noteAll(1);
+        return *this;
+    }
+
+    void noteAll(int sign) {
+        if (location == ItemLocation::None || sign == 0) return;
+        for (const ItemCount& kv : group) {
+            InventoryLedger::get().note(location, kv.first, sign * kv.second);
+            if (stocks()) noteStockEntry(this, kv.first, sign > 0);
+        }
+    }
+
+    // shelves and storage are what the StockIndex keeps track of
+    bool stocks() const {
+        return location == ItemLocation::Shelf ||
+               location == ItemLocation::Storage;
+    }
+
+    // Start (or stop) reporting to the ledger from here on
+    void track(ItemLocation where) {
+        noteAll(-1);
+        location = where;
+        noteAll(1);
+    }
+
+    ItemCount* lowerBound(int id) {
+        return (ItemCount*)lowerBound(group.begin(), group.end(), id);
+    }
+    const ItemCount* lowerBound(int id) const {
+        return lowerBound(group.begin(), group.end(), id);
+    }
+
+    static const ItemCount* lowerBound(const ItemCount* it,
+                                       const ItemCount* last, int id) {
+        int n = (int)(last - it);
+        if (n == 0) return it;
+        // binary search without the early exit, always log(n) steps and
+        // the compare turns into a cmov instead of a branch
+        while (n > 1) {
+            int half = n / 2;
+            it = it[half].first < id ? it + half : it;
+            n -= half;
+        }
+        return it + (it->first < id);
+    }
 
     void addItem(int itemID, int amount) {
-        if (group.find(itemID) == group.end()) {
-            group[itemID] = 0;
+        ItemCount* it = lowerBound(itemID);
+        if (it == group.end() || it->first != itemID) {
+            it = group.insert(it, ItemCount{itemID, 0});
+            if (stocks()) noteStockEntry(this, itemID, true);
         }
-        group[itemID] += amount;
+        it->second += amount;
+        InventoryLedger::get().note(location, itemID, amount);
     }
 
     // returns the amount removed
     int removeItem(int itemID, int amount) {
-        auto it = group.find(itemID);
-        if (it == group.end()) {
+        ItemCount* it = lowerBound(itemID);
+        if (it == group.end() || it->first != itemID) {
             log_warn(
                 "Trying to remove {} of {} but this ItemGroup doesnt have that",
                 amount, itemID);
             return 0;
         }
         if (it->second >= amount) {
-            group[itemID] -= amount;
+            it->second -= amount;
+            InventoryLedger::get().note(location, itemID, -amount);
             return amount;
         }
-        int has = group[itemID];
-        group.erase(itemID);
+        int has = it->second;
+        group.erase(it);
+        InventoryLedger::get().note(location, itemID, -has);
+        if (stocks()) noteStockEntry(this, itemID, false);
         return has;
     }
 
-    int operator[](int id) const { return group.find(id)->second; }
-    auto size() { return group.size(); }
-    auto begin() { return group.begin(); }
-    auto end() { return group.end(); }
+    // Adds everything in other. Both are sorted so a small group going into
+    // a big one (like adding up the whole store) only searches from where
+    // the last id landed, and two groups of about the same size are merged
+    // in one pass over both
+    void merge(const ItemGroup& other) {
+        if (other.empty()) return;
+        if (location != ItemLocation::None) {
+            for (const ItemCount& kv : other) {
+                InventoryLedger::get().note(location, kv.first, kv.second);
+            }
+        }
+        if (other.group.size() * 8 < group.size()) {
+            int from = 0;
+            for (const ItemCount& kv : other) {
+                ItemCount* it = (ItemCount*)lowerBound(group.begin() + from,
+                                                       group.end(), kv.first);
+                if (it == group.end() || it->first != kv.first) {
+                    it = group.insert(it, ItemCount{kv.first, 0});
+                    if (stocks()) noteStockEntry(this, kv.first, true);
+                }
+                it->second += kv.second;
+                from = (int)(it - group.begin()) + 1;
+            }
+            return;
+        }
 
-    auto begin() const { return group.begin(); }
-    auto end() const { return group.end(); }
+        SmallVector<ItemCount, INLINE> out;
+        out.reserve(group.size() + other.group.size());
+        const ItemCount* a = group.begin();
+        const ItemCount* b = other.group.begin();
+        while (a != group.end() || b != other.group.end()) {
+            if (b == other.group.end() ||
+                (a != group.end() && a->first < b->first)) {
+                out.push_back(*a++);
+            } else if (a == group.end() || b->first < a->first) {
+                if (stocks()) noteStockEntry(this, b->first, true);
+                out.push_back(*b++);
+            } else {
+                out.push_back(ItemCount{a->first, a->second + b->second});
+                a++;
+                b++;
+            }
+        }
+        group = std::move(out);
+    }
+
+    // 0 if we dont have any
+    int operator[](int id) const { return count(id); }
+    int count(int id) const {
+        auto it = find(id);
+        return it == end() ? 0 : it->second;
+    }
+    size_t size() const { return (size_t)group.size(); }
+    ItemCount* begin() { return group.begin(); }
+    ItemCount* end() { return group.end(); }
 
-    auto rbegin() const { return group.rbegin(); }
-    auto rend() const { return group.rend(); }
+    const ItemCount* begin() const { return group.begin(); }
+    const ItemCount* end() const { return group.end(); }
 
-    auto rbegin() { return group.rbegin(); }
-    auto rend() { return group.rend(); }
+    auto rbegin() const { return std::make_reverse_iterator(end()); }
+    auto rend() const { return std::make_reverse_iterator(begin()); }
 
-    auto empty() const { return group.empty(); }
-    auto find(int id) const { return group.find(id); }
+    auto rbegin() { return std::make_reverse_iterator(end()); }
+    auto rend() { return std::make_reverse_iterator(begin()); }
+
+    bool empty() const { return group.empty(); }
+    const ItemCount* find(int id) const {
+        const ItemCount* it = lowerBound(id);
+        return it != end() && it->first == id ? it : end();
+    }
 
     friend std::ostream& operator<<(std::ostream& os, const ItemGroup& ig) {
         for (auto& kv : ig.group) {
@@ -165,10 +473,14 @@ struct Storable : public Entity {
         if (contents.size() > 4) {
             log_warn("Contents is too large and so not all items will display");
         }
+        const ItemManager& items = ItemManager::get();
         int index = 0;
         for (auto& kv : contents) {
             if (index >= 4) break;
-            Item item = GLOBALS.get<ItemManager>("item_manager").get(kv.first);
+            // once per stack, the texture name is the interned copy so
+            // nothing gets built per quad
+            const glm::vec4& color = items.color(kv.first);
+            const std::string& texture = items.textureName(kv.first);
             auto basepos =
                 glm::vec3{position.x + item_positions[index].first,
                           position.y + item_positions[index].second, 0.f};
@@ -179,8 +491,8 @@ struct Storable : public Entity {
                      basepos.y + item_offsets[i].second,  // pos
                      basepos.z},                          // pos
                     {0.2f, 0.2f},                         // size
-                    item.color,                           // color
-                    item.textureName                      // textureName
+                    color,                                // color
+                    texture                               // textureName
                 );
             }
             index++;
@@ -188,12 +500,93 @@ struct Storable : public Entity {
     }
 };
 
+// Which shelves and storage boxes have an entry for each item id, so
+// finding the nearest shelf with milk only looks at the shelves that have
+// milk instead of checking the contents of every shelf in the store.
+//
+// Storables come and go through the layout listener, and while they are in
+// here their ItemGroup reports every id that shows up or goes away. Like
+// find() on the group an id stays listed at 0 until it is removed. Main
+// thread only, same as the ledger
+struct StockIndex {
+    // past this many it is quicker to let the spatial index search outward
+    // from where we are (see SpatialIndex::getEntityInRangeWithItem)
+    static constexpr int SCAN_LIMIT = 256;
+
+    std::unordered_map<const ItemGroup*, std::shared_ptr<Entity>> owners;
+    // [item id] -> everyone with an entry for it, in no particular order
+    std::vector<std::vector<std::shared_ptr<Entity>>> byItem;
+
+    // never destroyed, same reason as the ledger
+    inline static StockIndex& get() {
+        static StockIndex* index = new StockIndex();
+        return *index;
+    }
+
+    void add(const std::shared_ptr<Storable>& s) {
+        // already here if the listener got registered twice
+        if (!owners.emplace(&s->contents, s).second) return;
+        for (const ItemCount& kv : s->contents) note(kv.first, s, true);
+    }
+
+    void remove(const std::shared_ptr<Storable>& s) {
+        if (owners.erase(&s->contents) == 0) return;
+        for (const ItemCount& kv : s->contents) note(kv.first, s, false);
+    }
+
+    // groups we dont know about (people, shelves not placed yet) are ignored
+    void noteEntry(const ItemGroup* group, int id, bool added) {
+        auto it = owners.find(group);
+        if (it == owners.end()) return;
+        note(id, it->second, added);
+    }
+
+    void note(int id, const std::shared_ptr<Entity>& e, bool added) {
+        if (id < 0) return;
+        if (id >= (int)byItem.size()) byItem.resize(id + 1);
+        auto& list = byItem[id];
+        if (added) {
+            list.push_back(e);
+            return;
+        }
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i].get() != e.get()) continue;
+            list[i] = list.back();
+            list.pop_back();
+            return;
+        }
+    }
+
+    const std::vector<std::shared_ptr<Entity>>& stocking(int id) const {
+        static const std::vector<std::shared_ptr<Entity>> none;
+        return id >= 0 && id < (int)byItem.size() ? byItem[id] : none;
+    }
+
+    // Registered with SpatialIndex::addLayoutListener
+    static void onLayoutChanged(const std::shared_ptr<Entity>& e,
+                                bool added) {
+        auto s = dynamic_pointer_cast<Storable>(e);
+        if (!s) return;
+        if (added) {
+            get().add(s);
+        } else {
+            get().remove(s);
+        }
+    }
+};
+
+inline void noteStockEntry(const ItemGroup* group, int id, bool added) {
+    StockIndex::get().noteEntry(group, id, added);
+}
+
 struct Storage : public Storable {
     virtual const char* typeString() const override { return "Storage"; }
 
     Storage(const glm::vec2& position, const glm::vec2& size, float angle,
             const glm::vec4& color, const std::string& textureName)
-        : Storable(position, size, angle, color, textureName) {}
+        : Storable(position, size, angle, color, textureName) {
+        contents.track(ItemLocation::Storage);
+    }
 };
 
 struct Shelf : public Storable {
@@ -201,6 +594,8 @@ struct Shelf : public Storable {
 
     Shelf(const glm::vec2& position, const glm::vec2& size, float angle,
           const glm::vec4& color, const std::string& textureName)
-        : Storable(position, size, angle, color, textureName) {}
+        : Storable(position, size, angle, color, textureName) {
+        contents.track(ItemLocation::Shelf);
+    }
 };
 
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+
 #include "../vendor/supermarket-engine/engine/log.h"
 #include "../vendor/supermarket-engine/engine/pch.hpp"
 
@@ -57,10 +60,43 @@ constexpr inline const char* jobTypeToString(JobType t) {
     }
 }
 
+// Extra state a job type needs while someone is working on it. Fixed size so
+// jobs can live in the JobPool, add a field here instead of a string keyed
+// map
+struct JobPayload {
+    // Fill: how many items we actually got our hands on
+    int amount = 0;
+};
+
+// Who owns a job right now. Workers take a job by moving it from Open to
+// Claimed with a compare exchange, so two of them can never both get it
+enum class JobState : uint8_t {
+    Open,
+    Claimed,
+    Done,
+};
+
+// std::atomic cant be copied, which Job needs to be so it can be set up with
+// designated initializers and then copied into the pool. Only copy while
+// nobody else can see either side
+template <typename T>
+struct CopyableAtomic : std::atomic<T> {
+    CopyableAtomic(T v = T()) : std::atomic<T>(v) {}
+    CopyableAtomic(const CopyableAtomic& o)
+        : std::atomic<T>(o.load(std::memory_order_relaxed)) {}
+    CopyableAtomic& operator=(const CopyableAtomic& o) {
+        this->store(o.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+        return *this;
+    }
+};
+
 struct Job {
     JobType type;
+    // set by the job handler once the work is done, whoever is working on
+    // the job then calls JobQueue::complete
     bool isComplete;
-    bool isAssigned;
+    CopyableAtomic<JobState> state = JobState::Open;
     int reserved = -1;
     glm::vec2 startPosition;
     glm::vec2 endPosition;
@@ -70,11 +106,23 @@ struct Job {
     int itemID;
     int itemAmount;
 
-    // TODO do we need dynamic types so that we can enforce extra data?
-    // just gotta remember which you are using
-    // if you mess it up well too bad
     int jobStatus = 0;
-    std::map<std::string, int> reg;
+    JobPayload payload;
+
+    bool isAssigned() const { return state.load() == JobState::Claimed; }
+
+    // owned by JobQueue, neighbors in the list of unassigned jobs we are in.
+    // Only touched by JobQueue::flush
+    Job* queuePrev = nullptr;
+    Job* queueNext = nullptr;
+    bool linked = false;
+    // unassigned, goes back to the front of the line instead of the end
+    CopyableAtomic<bool> requeue = false;
+    // changed since the last flush, see JobQueue::touch
+    CopyableAtomic<bool> touched = false;
+    Job* touchedNext = nullptr;
+    // where we live in the JobPool, -1 if not queued
+    int slot = -1;
 };
 
 template <>
@@ -98,60 +146,554 @@ struct JobRange {
     JobType end;
 };
 
-static std::map<int, std::vector<std::shared_ptr<Job>>> jobs;
-struct JobQueue {
-    static void addJob(JobType t, const std::shared_ptr<Job>& j) {
-        jobs[(int)t].push_back(j);
-    }
-
-    static int numOfJobsWithType(JobType t) { return jobs[(int)t].size(); }
-
-    static std::vector<std::shared_ptr<Job>>::iterator getNextMatching(
-        JobType t) {
-        auto js = jobs[(int)t];
-        for (auto it = js.begin(); it != js.end(); it++) {
-            if ((*it)->isAssigned || (*it)->isComplete) continue;
-            return it;
-        }
-        return jobs[(int)t].end();
-    }
-
-    static std::shared_ptr<Job> getNextInRange(int e_id, JobRange jr) {
-        // note that we iterate backwards so that higher pri
-        // gets chosen first
-        // TODO - do we need to set a timer so that some jobs eventually
-        // get forced to do
-        for (int i = (int)jr.end; i >= jr.start; i--) {
-            auto js = jobs[i];
-            for (auto it = js.begin(); it != js.end(); it++) {
-                if ((*it)->isAssigned || (*it)->isComplete) continue;
-                if ((*it)->reserved != -1 && (*it)->reserved != e_id) continue;
-                if ((*it)->type <= jr.end && (*it)->type >= jr.start)
-                    return *it;
+// Unassigned jobs of a single type, oldest first. Linked through the jobs
+// themselves so taking one out of the middle doesnt need a search
+struct JobList {
+    Job* head = nullptr;
+    Job* tail = nullptr;
+
+    bool empty() const { return head == nullptr; }
+
+    void push(Job* j) {
+        j->linked = true;
+        j->queuePrev = tail;
+        j->queueNext = nullptr;
+        if (tail) {
+            tail->queueNext = j;
+        } else {
+            head = j;
+        }
+        tail = j;
+    }
+
+    void pushFront(Job* j) {
+        j->linked = true;
+        j->queuePrev = nullptr;
+        j->queueNext = head;
+        if (head) {
+            head->queuePrev = j;
+        } else {
+            tail = j;
+        }
+        head = j;
+    }
+
+    void remove(Job* j) {
+        if (j->queuePrev) {
+            j->queuePrev->queueNext = j->queueNext;
+        } else {
+            head = j->queueNext;
+        }
+        if (j->queueNext) {
+            j->queueNext->queuePrev = j->queuePrev;
+        } else {
+            tail = j->queuePrev;
+        }
+        j->queuePrev = j->queueNext = nullptr;
+        j->linked = false;
+    }
+};
+
+// Points at a job in the JobPool. Once the job is completed its slot gets a
+// new generation so any handles still pointing at it stop resolving
+struct JobHandle {
+    int index = -1;
+    uint32_t generation = 0;
+
+    explicit operator bool() const { return index >= 0; }
+    bool operator==(const JobHandle& o) const {
+        return index == o.index && generation == o.generation;
+    }
+    bool operator!=(const JobHandle& o) const { return !(*this == o); }
+};
+
+// Slab allocator for jobs. Chunks never move so a Job* is good until the job
+// is released, and released slots get reused so steady job churn doesnt
+// touch the heap.
+//
+// create() and get() can be called from any thread. Free slots are a
+// lock free stack, the head carries a tag that changes on every pop so a
+// slot that got popped and pushed back in the meantime doesnt fool us (ABA)
+struct JobPool {
+    static constexpr int CHUNK = 256;
+    // chunk table is fixed so readers never see it move, 1M jobs
+    static constexpr int MAX_CHUNKS = 4096;
+
+    struct Slot {
+        Job job;
+        std::atomic<uint32_t> generation{0};
+        std::atomic<bool> used{false};
+        // next free slot (+1, 0 is the end of the list)
+        std::atomic<int> nextFree{0};
+    };
+
+    std::atomic<Slot*> chunks[MAX_CHUNKS] = {};
+    std::atomic<int> numChunks{0};
+    // (tag << 32) | (index + 1)
+    std::atomic<uint64_t> freeHead{0};
+    std::atomic<int> numUsed{0};
+
+    JobPool() {}
+    JobPool(const JobPool&) = delete;
+    ~JobPool() { reset(); }
+
+    int capacity() const { return numChunks.load() * CHUNK; }
+
+    Slot& slotAt(int index) {
+        return chunks[index / CHUNK].load(std::memory_order_acquire)
+            [index % CHUNK];
+    }
+
+    JobHandle create(const Job& j) {
+        int index = pop();
+        Slot& s = slotAt(index);
+        s.job = j;
+        s.job.slot = index;
+        s.job.touched.store(false, std::memory_order_relaxed);
+        s.used.store(true, std::memory_order_release);
+        numUsed.fetch_add(1, std::memory_order_relaxed);
+        return JobHandle{index, s.generation.load(std::memory_order_relaxed)};
+    }
+
+    // nullptr if the handle is stale
+    Job* get(JobHandle h) {
+        if (h.index < 0 || h.index >= capacity()) return nullptr;
+        Slot& s = slotAt(h.index);
+        if (!s.used.load(std::memory_order_acquire)) return nullptr;
+        if (s.generation.load() != h.generation) return nullptr;
+        return &s.job;
+    }
+
+    JobHandle handleOf(const Job& j) {
+        return JobHandle{j.slot, slotAt(j.slot).generation.load()};
+    }
+
+    // Only once nobody can be looking at the job anymore, see
+    // JobQueue::flush
+    void release(int index) {
+        Slot& s = slotAt(index);
+        s.used.store(false, std::memory_order_relaxed);
+        // nobody else can be changing it, no need for an increment
+        s.generation.store(s.generation.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+        s.job.slot = -1;
+        numUsed.fetch_sub(1, std::memory_order_relaxed);
+        push(index, index);
+    }
+
+    int pop() {
+        uint64_t head = freeHead.load(std::memory_order_acquire);
+        while (true) {
+            int index = (int)(head & 0xffffffff) - 1;
+            if (index < 0) {
+                grow();
+                head = freeHead.load(std::memory_order_acquire);
+                continue;
             }
+            uint64_t next = slotAt(index).nextFree.load();
+            uint64_t tag = (head >> 32) + 1;
+            if (freeHead.compare_exchange_weak(head, (tag << 32) | next,
+                                               std::memory_order_acq_rel,
+                                               std::memory_order_acquire))
+                return index;
+        }
+    }
+
+    // first..last are already linked together through nextFree
+    void push(int first, int last) {
+        uint64_t head = freeHead.load(std::memory_order_acquire);
+        while (true) {
+            slotAt(last).nextFree.store((int)(head & 0xffffffff));
+            uint64_t tag = head >> 32;
+            if (freeHead.compare_exchange_weak(
+                    head, (tag << 32) | (uint64_t)(first + 1),
+                    std::memory_order_acq_rel, std::memory_order_acquire))
+                return;
+        }
+    }
+
+    void grow() {
+        int n = numChunks.load(std::memory_order_acquire);
+        M_ASSERT(n < MAX_CHUNKS, "JobPool is out of room");
+        Slot* chunk = new Slot[CHUNK];
+        int base = n * CHUNK;
+        for (int i = 0; i < CHUNK - 1; i++) chunk[i].nextFree = base + i + 2;
+
+        // someone else might be growing at the same time, only one of us
+        // gets to install the chunk and the other goes back to popping
+        Slot* expected = nullptr;
+        if (!chunks[n].compare_exchange_strong(expected, chunk)) {
+            delete[] chunk;
+            return;
+        }
+        numChunks.store(n + 1, std::memory_order_release);
+        push(base, base + CHUNK - 1);
+    }
+
+    // Not thread safe
+    void reset() {
+        for (int i = 0; i < numChunks.load(); i++) {
+            delete[] chunks[i].load();
+            chunks[i].store(nullptr);
+        }
+        numChunks.store(0);
+        freeHead.store(0);
+        numUsed.store(0);
+    }
+};
+
+struct JobQueueData {
+    // every job that hasnt been completed yet
+    JobPool pool;
+    // unassigned jobs anyone can pick up
+    JobList open[MAX_JOB_TYPE];
+    // unassigned jobs only the entity with that id can pick up
+    std::unordered_map<int, std::array<JobList, MAX_JOB_TYPE>> reserved;
+    // jobs that changed since the last flush, linked through touchedNext
+    std::atomic<Job*> touched{nullptr};
+
+    std::atomic<int> count[MAX_JOB_TYPE] = {};
+    std::atomic<int> assigned[MAX_JOB_TYPE] = {};
+};
+
+static JobQueueData jobs_DO_NOT_USE;
+
+// Jobs waiting for someone to do them.
+//
+// Safe to use from any number of threads at once, except for flush() and
+// clear() which need everyone else to be done (SuperLayer calls flush once
+// a tick between entity updates).
+//
+// Claiming is a compare exchange on Job::state so it happens right away.
+// Everything that changes the lists (adding, completing, putting a job
+// back) only marks the job as touched and flush() sorts it out later. Until
+// then claimed jobs stay in the lists and get skipped, new jobs arent
+// visible yet and completed jobs keep their slot
+struct JobQueue {
+    static JobQueueData& data() { return jobs_DO_NOT_USE; }
+
+    static JobList& listFor(Job* j) {
+        if (j->reserved == -1) return data().open[j->type];
+        return data().reserved[j->reserved][j->type];
+    }
+
+    static void unlink(Job* j) {
+        listFor(j).remove(j);
+        if (j->reserved == -1) return;
+        // customers come and go, dont keep their empty lists around
+        auto it = data().reserved.find(j->reserved);
+        for (auto& list : it->second) {
+            if (!list.empty()) return;
+        }
+        data().reserved.erase(it);
+    }
+
+    // Queue j up for the next flush, once per flush no matter how many
+    // times it changes
+    static void touch(Job* j) {
+        if (j->touched.exchange(true)) return;
+        Job* head = data().touched.load(std::memory_order_relaxed);
+        do {
+            j->touchedNext = head;
+        } while (!data().touched.compare_exchange_weak(
+            head, j, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Copies j into the pool, it can be claimed after the next flush
+    static JobHandle addJob(JobType t, const Job& j) {
+        JobQueueData& q = data();
+        JobHandle handle = q.pool.create(j);
+        Job* job = q.pool.get(handle);
+        job->type = t;
+        job->linked = false;
+        q.count[t]++;
+        if (job->isAssigned()) q.assigned[t]++;
+        touch(job);
+        return handle;
+    }
+
+    // nullptr once the job has been completed
+    static Job* get(JobHandle h) {
+        Job* j = data().pool.get(h);
+        if (!j || j->state.load() == JobState::Done) return nullptr;
+        return j;
+    }
+
+    // all jobs of this type that arent done yet, assigned or not
+    static int numOfJobsWithType(JobType t) { return data().count[t]; }
+    static int numAssignedWithType(JobType t) { return data().assigned[t]; }
+
+    // oldest first, only the ones nobody has reserved. Can include jobs
+    // claimed since the last flush
+    static const JobList& openJobs(JobType t) { return data().open[t]; }
+
+    // oldest first, nullptr if there arent any
+    static Job* firstReservedFor(int e_id, JobType t) {
+        auto it = data().reserved.find(e_id);
+        return it == data().reserved.end() ? nullptr : it->second[t].head;
+    }
+
+    // Takes j if nobody else has, empty handle if we lost
+    static JobHandle claim(Job* j) {
+        JobState expected = JobState::Open;
+        if (!j->state.compare_exchange_strong(expected, JobState::Claimed,
+                                              std::memory_order_acq_rel))
+            return JobHandle();
+        data().assigned[j->type]++;
+        touch(j);
+        return data().pool.handleOf(*j);
+    }
+
+    // Puts a claimed job back at the front of the line
+    static void unassign(JobHandle h) {
+        Job* j = get(h);
+        if (!j) return;
+        JobState expected = JobState::Claimed;
+        if (!j->state.compare_exchange_strong(expected, JobState::Open,
+                                              std::memory_order_acq_rel))
+            return;
+        data().assigned[j->type]--;
+        // whoever claims it next can put it back too, so this races
+        j->requeue.store(true, std::memory_order_relaxed);
+        touch(j);
+    }
+
+    static Job* firstOpen(Job* j) {
+        while (j &&
+               j->state.load(std::memory_order_relaxed) != JobState::Open) {
+            j = j->queueNext;
         }
-        return nullptr;
+        return j;
     }
 
-    static void cleanup() {
-        for (auto& kv : jobs) {
-            auto it = kv.second.begin();
-            while (it != kv.second.end()) {
-                if ((*it)->isComplete) {
-                    it = kv.second.erase(it);
-                } else {
-                    it++;
+    // Highest priority job in range that e_id is allowed to take, the job
+    // is claimed and wont be handed out again
+    static JobHandle getNextInRange(int e_id, JobRange jr) {
+        JobQueueData& q = data();
+        auto mine = q.reserved.find(e_id);
+        // ranges use the boundaries (even MAX_JOB_TYPE) as their ends
+        int end = std::min((int)jr.end, (int)JobType::MAX_JOB_TYPE - 1);
+        int start = std::max((int)jr.start, 0);
+        for (int i = end; i >= start; i--) {
+            // things reserved for us first, someone asked us specifically
+            if (mine != q.reserved.end()) {
+                for (Job* j = firstOpen(mine->second[i].head); j;
+                     j = firstOpen(j->queueNext)) {
+                    if (JobHandle h = claim(j)) return h;
                 }
             }
+            for (Job* j = firstOpen(q.open[i].head); j;
+                 j = firstOpen(j->queueNext)) {
+                if (JobHandle h = claim(j)) return h;
+            }
+        }
+        return JobHandle();
+    }
+
+    // Marks the job done, call once whoever was working on it is finished.
+    // Its slot gets freed on the next flush
+    static void complete(JobHandle h) {
+        Job* j = get(h);
+        if (!j) return;
+        j->isComplete = true;
+        JobState was = j->state.exchange(JobState::Done);
+        if (was == JobState::Done) return;
+        if (was == JobState::Claimed) data().assigned[j->type]--;
+        data().count[j->type]--;
+        touch(j);
+    }
+
+    // Brings the lists up to date with everything that happened since the
+    // last flush. Nobody else can be using the queue while this runs
+    static void flush() {
+        JobQueueData& q = data();
+        Job* j = q.touched.exchange(nullptr, std::memory_order_acquire);
+        // the stack is newest first, flip it so jobs keep the order they
+        // were added in
+        Job* ordered = nullptr;
+        while (j) {
+            Job* next = j->touchedNext;
+            j->touchedNext = ordered;
+            ordered = j;
+            j = next;
+        }
+        for (j = ordered; j;) {
+            Job* next = j->touchedNext;
+            j->touchedNext = nullptr;
+            j->touched.store(false, std::memory_order_relaxed);
+            switch (j->state.load()) {
+                case JobState::Open:
+                    if (!j->linked) {
+                        if (j->requeue) {
+                            listFor(j).pushFront(j);
+                        } else {
+                            listFor(j).push(j);
+                        }
+                    }
+                    j->requeue.store(false, std::memory_order_relaxed);
+                    break;
+                case JobState::Claimed:
+                    if (j->linked) unlink(j);
+                    break;
+                case JobState::Done:
+                    if (j->linked) unlink(j);
+                    q.pool.release(j->slot);
+                    break;
+            }
+            j = next;
+        }
+    }
+
+    static void clear() {
+        JobQueueData& q = data();
+        q.touched.store(nullptr);
+        q.pool.reset();
+        for (auto& list : q.open) list = JobList();
+        q.reserved.clear();
+        for (auto& c : q.count) c.store(0);
+        for (auto& c : q.assigned) c.store(0);
+    }
+};
+
+// Where a worker has to walk to first to get started on j
+inline glm::vec2 jobStartPosition(const Job& j) {
+    switch (j.type) {
+        case JobType::Fill:
+        case JobType::Empty:
+        case JobType::FindItem:
+            return j.startPosition;
+        default:
+            return j.endPosition;
+    }
+}
+
+// Collects every idle worker during a tick and then hands out jobs to all of
+// them at once, so the closest worker gets the job instead of whoever
+// happened to update first.
+//
+// Priority still wins, a worker always gets the highest type it can take.
+// Distance to jobStartPosition only decides who gets which job within a
+// type, and jobs reserved for a worker go to them before anything else
+struct JobAssigner {
+    // only look at this many of the oldest open jobs of a type per idle
+    // worker, otherwise a huge backlog makes every tick slow
+    static constexpr int CANDIDATES_PER_WORKER = 4;
+    static constexpr int MAX_CANDIDATES = 256;
+
+    struct Request {
+        int id;
+        glm::vec2 position;
+        JobRange range;
+    };
+
+    struct Assignment {
+        int id;
+        JobHandle job;
+        bool taken = false;
+    };
+
+    std::vector<Request> requests;
+    // handed out last tick, sorted by entity id. Doesnt change until the
+    // next assign() so everyone can look theirs up at the same time
+    std::vector<Assignment> assigned;
+    int jobsAssigned = 0;
+
+    // scratch space, kept around between ticks
+    std::vector<bool> matched;
+    std::vector<Job*> candidates;
+    // (not reserved, distance, request, queue index, job). Ties go to
+    // whichever job is first in the queue, never to the Job* (that would
+    // depend on where the JobPool chunks ended up on the heap)
+    std::vector<std::tuple<bool, float, int, int, Job*>> pairs;
+
+    inline static JobAssigner& get() {
+        static JobAssigner assigner;
+        return assigner;
+    }
+
+    void request(int id, const glm::vec2& position, JobRange range) {
+        requests.push_back(Request{id, position, range});
+    }
+
+    // The job assign() picked for id last tick, if any. Safe to call from
+    // the think phase (see EntityUpdater) as long as id is your own
+    JobHandle take(int id) {
+        auto it = std::lower_bound(
+            assigned.begin(), assigned.end(), id,
+            [](const Assignment& a, int i) { return a.id < i; });
+        if (it == assigned.end() || it->id != id || it->taken) {
+            return JobHandle();
+        }
+        it->taken = true;
+        return it->job;
+    }
+
+    // Call once a tick from the main thread after everyone had a chance to
+    // request, flushes the JobQueue so nobody else can be using it
+    void assign() {
+        // whoever didnt come back for their job is gone
+        for (auto& a : assigned) {
+            if (!a.taken) JobQueue::unassign(a.job);
         }
-        auto it = jobs.begin();
-        while (it != jobs.end()) {
-            if (it->second.empty()) {
-                it = jobs.erase(it);
-            } else {
-                it++;
+        assigned.clear();
+        JobQueue::flush();
+        if (requests.empty()) return;
+
+        matched.assign(requests.size(), false);
+        int limit = std::min(MAX_CANDIDATES,
+                             (int)requests.size() * CANDIDATES_PER_WORKER);
+
+        for (int t = JobType::MAX_JOB_TYPE - 1; t >= 0; t--) {
+            JobType type = (JobType)t;
+            candidates.clear();
+            for (Job* j = JobQueue::openJobs(type).head;
+                 j && (int)candidates.size() < limit; j = j->queueNext) {
+                candidates.push_back(j);
+            }
+
+            pairs.clear();
+            for (int r = 0; r < (int)requests.size(); r++) {
+                const Request& req = requests[r];
+                if (matched[r]) continue;
+                if (t < req.range.start || t > req.range.end) continue;
+                if (Job* j = JobQueue::firstReservedFor(req.id, type)) {
+                    pairs.push_back({false, 0.f, r, -1, j});
+                }
+                for (int c = 0; c < (int)candidates.size(); c++) {
+                    Job* j = candidates[c];
+                    float d =
+                        glm::distance(req.position, jobStartPosition(*j));
+                    pairs.push_back({true, d, r, c, j});
+                }
+            }
+            if (pairs.empty()) continue;
+
+            // closest pairs first, greedy but good enough for a store
+            std::sort(pairs.begin(), pairs.end());
+            for (auto& pair : pairs) {
+                int r = std::get<2>(pair);
+                Job* j = std::get<4>(pair);
+                if (matched[r]) continue;
+                JobHandle h = JobQueue::claim(j);
+                if (!h) continue;
+                matched[r] = true;
+                assigned.push_back({requests[r].id, h});
+                jobsAssigned++;
             }
         }
+        std::sort(assigned.begin(), assigned.end(),
+                  [](const Assignment& a, const Assignment& b) {
+                      return a.id < b.id;
+                  });
+        requests.clear();
+    }
+
+    void clear() {
+        for (auto& a : assigned) {
+            if (!a.taken) JobQueue::unassign(a.job);
+        }
+        assigned.clear();
+        requests.clear();
     }
 };
 
@@ -159,8 +701,7 @@ struct WorkInput {
     Time dt;
 };
 
-typedef std::function<bool(const std::shared_ptr<Job>&, WorkInput input)>
-    JobHandlerFn;
+typedef std::function<bool(Job&, WorkInput input)> JobHandlerFn;
 
 struct JobHandler {
     std::unordered_map<int, JobHandlerFn> job_mapping;
@@ -171,12 +712,12 @@ struct JobHandler {
         job_mapping[(int)jt] = func;
     }
 
-    void handle(const std::shared_ptr<Job>& j, const WorkInput& input) {
-        if (job_mapping.find((int)j->type) == job_mapping.end()) {
+    void handle(Job& j, const WorkInput& input) {
+        if (job_mapping.find((int)j.type) == job_mapping.end()) {
             log_warn("Got job of type {} but dont have a handler for it",
-                     jobTypeToString(j->type));
+                     jobTypeToString(j.type));
             return;
         }
-        job_mapping[(int)j->type](j, input);
+        job_mapping[(int)j.type](j, input);
     }
 };
@@ -22,6 +22,7 @@
 #include "global.h"
 
 // Requires access to the camera and entitites
+#include "benchmarks.h"
 #include "debug_layers.h"
 #include "menulayer.h"
 #include "superlayer.h"
@@ -39,6 +40,13 @@ int main(int argc, char** argv) {
     backward::SignalHandling sh;
 
     all_tests();
+
+    // BENCHMARK=1 ./super.exe or make bench
+    if (getenv("BENCHMARK")) {
+        all_benchmarks();
+        return 0;
+    }
+
     add_globals();
 
     App::create({
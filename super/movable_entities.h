@@ -4,9 +4,14 @@
 #include "../vendor/supermarket-engine/engine/entity.h"
 #include "../vendor/supermarket-engine/engine/maputil.h"
 #include "../vendor/supermarket-engine/engine/pch.hpp"
-#include "../vendor/supermarket-engine/engine/thetastar.h"
+#include "entity_update.h"
+#include "flow_field.h"
 #include "item.h"
 #include "job.h"
+#include "movement.h"
+#include "occupancy_grid.h"
+#include "path_service.h"
+#include "rng.h"
 
 const float REACH_DIST = 1.4f;
 const float TRAVEL_DIST = 0.2f;
@@ -23,15 +28,12 @@ inline std::vector<glm::vec2> generateWalkablePath(  //
 
     // TODO @FIX trace actually will still run
     // we gotta do some kind of fancy #if log thing
-    log_trace("starting theta");
-
-    Theta t(start, end,
-            // TODO figure out a better bounds than this
-            glm::vec4{-20.f, -20.f, 20.f, 20.f},
-            std::bind(EntityHelper::isWalkable, std::placeholders::_1, size),
-            elideLineOfSight);
-    auto a = t.go();
-    std::reverse(a.begin(), a.end());
+    log_trace("starting path search");
+
+    // same read only copy the PathService workers search
+    auto grid = PathService::get().snapshotFor(size);
+    auto a = findPath(Walkable{grid.get(), grid->findLayer(size)}, start, end,
+                      elideLineOfSight);
     for (auto i : a) {
         log_trace("{}", i);
     }
@@ -39,12 +41,11 @@ inline std::vector<glm::vec2> generateWalkablePath(  //
 }
 
 struct MovableEntity : public Entity {
-    const glm::vec2 INVALID = {-99.f, -99.f};
-    glm::vec2 last = glm::vec2(INVALID);
-    std::vector<glm::vec2> path;
-    float moveSpeed = 0.05f;
-    float timeBetweenMoves = 0.025f;
-    float timeSinceLastMove = 0.025f;
+    PathCursor path;
+    // path we are waiting on from the PathService
+    PathTicket pendingPath;
+    // speed and move timer live in the MovementStore
+    MovementSlot movement;
 
     virtual inline bool canMove() const override { return true; }
 
@@ -52,7 +53,7 @@ struct MovableEntity : public Entity {
         prof give_me_a_name(__PROFILE_FUNC__);
         if (glm::distance(position, location) > 1000.f) {
             // TODO why is this happening
-            position = glm::vec2{0.f, 0.f};
+            Intents::move(*this, glm::vec2{0.f, 0.f});
             log_warn(
                 "We dont support any maps over 1k distances so something is "
                 "wrong (trying to walk from {} to {})",
@@ -70,28 +71,47 @@ struct MovableEntity : public Entity {
             // fmt::format(" distance to location end {}  (need to be within
             // {})", glm::distance(position, location), TRAVEL_DIST));
 
-            path = generateWalkablePath(id, moveSpeed, position, location,
-                                        this->size);
+            // lots of people are going here, just follow the flow field
+            if (const FlowField* field =
+                    FlowFieldCache::get().find(location, this->size)) {
+                if (auto target = field->target(position, location)) {
+                    cancelPath();
+                    moveTowards(*target, wi);
+                    return false;
+                }
+            }
+
+            // ask for a new path if we havent yet or we changed our mind
+            if (!pendingPath || pendingPath->end != location) {
+                cancelPath();
+                requestPath(location);
+            }
+            // stand still until a worker gets to us
+            if (!pendingPath ||
+                !pendingPath->done.load(std::memory_order_acquire)) {
+                return false;
+            }
+            // shared with the PathService cache, no copy
+            path = PathCursor(pendingPath->path, location);
+            pendingPath.reset();
             return false;
         }
 
         // Did we already generate a path?
         if (!path.empty()) {
-            // first time we are moving, just set last to our current position
-            if (last == INVALID) last = glm::vec2(position);
             // try to grab the next spot in the path
-            auto target = path.begin();
-            if (target == path.end()) return true;
+            glm::vec2 target = path.front();
 
-            if (!EntityHelper::isWalkable(*target, this->size)) {
+            // runs on the pool threads, cant be building layers
+            if (!Occupancy::isWalkableReadOnly(target, this->size)) {
                 announce(fmt::format("my next target isnt walkable.... {}",
-                                     *target));
+                                     target));
             }
 
-            // reached our local target, erase this
+            // reached our local target, move past it
             // and next cycle we'll grab the next POI
-            if (distance(position, *target) < TRAVEL_DIST) {
-                path.erase(target);
+            if (distance(position, target) < TRAVEL_DIST) {
+                path.pop();
                 // announce(fmt::format(" reached local target, {} to go",
                 // path.size()));
                 return path.empty() ? true : false;
@@ -104,22 +124,45 @@ struct MovableEntity : public Entity {
             // and the character will just sit there and do nothing since path
             // is always empty
 
-            // TODO @FIX moveSpeed is not really moveSpeed,
+            // TODO @FIX speed is not really speed,
             // its move distance and so we cant actually
             // change the speed without breaking pathing..
             // what we could is track the DT and just only apply the lerp
             // every x seconds instead
             //
-            timeSinceLastMove += wi.dt.s();
-            if (timeSinceLastMove >= timeBetweenMoves) {
-                timeSinceLastMove = 0;
-                position = lerp(position, *target, moveSpeed);
-            }
+            moveTowards(target, wi);
             return false;
         }
         return false;
     }
 
+    // The step itself happens in MovementStore::integrate with everyone
+    // else's once the think phase is over
+    void moveTowards(const glm::vec2& target, const WorkInput& wi) {
+        MovementStore& store = MovementStore::get();
+        store.request(movement.index, this, target);
+        // nobody is going to integrate for us outside of EntityUpdater
+        if (!Intents::current()) {
+            store.integrate(wi.dt.s(), movement.index, movement.index + 1);
+        }
+    }
+
+    // The PathService and flow fields only work from the main thread, the
+    // ticket shows up once intents are applied
+    void requestPath(const glm::vec2& location) {
+        glm::vec2 start = position;
+        Intents::later(*this, [this, start, location](int) {
+            FlowFieldCache::get().noteRequest(location, this->size);
+            pendingPath =
+                PathService::get().submit(start, location, this->size);
+        });
+    }
+
+    void cancelPath() {
+        if (pendingPath) pendingPath->cancelled = true;
+        pendingPath.reset();
+    }
+
     virtual void onUpdate(Time dt) override {
         (void)dt;
         if (angle >= 360) angle -= 360;
@@ -129,29 +172,39 @@ struct MovableEntity : public Entity {
 
 struct Person : public MovableEntity {
     JobHandler handler;
-    std::shared_ptr<Job> assignedJob;
-
-    void startJob(const std::shared_ptr<Job> job) {
-        assignedJob = job;
-        if (!assignedJob) return;
+    JobHandle assignedJob;
+    // only this person draws from it, so it is safe in the think phase
+    Rng rng = RngService::get().forEntity(id);
+
+    void startJob(JobHandle handle) {
+        Job* job = JobQueue::get(handle);
+        if (!job) return;
+        assignedJob = handle;
         path.clear();
-        assignedJob->isAssigned = true;
+        cancelPath();
         announce(fmt::format("starting job {}", *job));
     }
 
     void workOrFindMore(Time dt) {
-        if (!assignedJob) {
+        Job* job = JobQueue::get(assignedJob);
+        if (!job) {
             // announce("finding new job");
-            auto range = getJobRange();
-            auto ptr = JobQueue::getNextInRange(id, range);
-            startJob(ptr);
+            // jobs get handed out once a tick, see JobAssigner
+            JobHandle handle = JobAssigner::get().take(id);
+            if (!handle) {
+                Intents::requestJob(*this, position, getJobRange());
+                return;
+            }
+            startJob(handle);
             return;
         }
-        handler.handle(assignedJob, {dt});
-        if (assignedJob->isComplete) {
-            announce(fmt::format("finished with {}",
-                                 jobTypeToString(assignedJob->type)));
-            assignedJob.reset();
+        handler.handle(*job, {dt});
+        if (job->isComplete) {
+            announce(
+                fmt::format("finished with {}", jobTypeToString(job->type)));
+            // job is gone after this
+            Intents::completeJob(*this, assignedJob);
+            assignedJob = JobHandle();
         }
     }
 
@@ -164,11 +217,11 @@ struct Person : public MovableEntity {
     virtual void registerJobHandlers() = 0;
     virtual JobRange getJobRange() { return {JobType::None, JobType::None}; }
 
-    bool none(const std::shared_ptr<Job>& j, const WorkInput& input) {
-        j->seconds = j->seconds - input.dt.s();
-        if (j->seconds <= 0) {
-            announce(fmt::format("completed job {}", jobTypeToString(j->type)));
-            j->isComplete = true;
+    bool none(Job& j, const WorkInput& input) {
+        j.seconds = j.seconds - input.dt.s();
+        if (j.seconds <= 0) {
+            announce(fmt::format("completed job {}", jobTypeToString(j.type)));
+            j.isComplete = true;
             return true;
         }
         return false;
@@ -0,0 +1,139 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/entity.h"
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Movement state for everything that walks, one array per field so the
+// integrator goes over all of it in one tight loop instead of chasing a
+// shared_ptr and a virtual call per agent.
+//
+// During the think phase an agent only writes its own slot (see
+// MovableEntity::moveTowards), then once intents are applied integrate()
+// steps every agent that asked to move and copies the new positions back
+// to the entities.
+struct MovementStore {
+    // where the agent was when it asked to move, and where it wants to go
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> targetX;
+    std::vector<float> targetY;
+    // fraction of the way to the target covered per move
+    std::vector<float> speed;
+    std::vector<float> sinceMove;
+    std::vector<float> betweenMoves;
+    // 1 if the agent asked to move this tick, float so the loop doesnt
+    // need a branch
+    std::vector<float> moving;
+    std::vector<Entity*> owner;
+    std::vector<int> freeSlots;
+
+    // never destroyed, entities in the global list can outlive it at exit
+    inline static MovementStore& get() {
+        static MovementStore* store = new MovementStore();
+        return *store;
+    }
+
+    int size() const { return (int)x.size(); }
+
+    int alloc() {
+        if (!freeSlots.empty()) {
+            int i = freeSlots.back();
+            freeSlots.pop_back();
+            reset(i);
+            return i;
+        }
+        x.push_back(0.f);
+        y.push_back(0.f);
+        targetX.push_back(0.f);
+        targetY.push_back(0.f);
+        speed.push_back(0.f);
+        sinceMove.push_back(0.f);
+        betweenMoves.push_back(0.f);
+        moving.push_back(0.f);
+        owner.push_back(nullptr);
+        reset(size() - 1);
+        return size() - 1;
+    }
+
+    void reset(int i) {
+        speed[i] = 0.05f;
+        betweenMoves[i] = 0.025f;
+        sinceMove[i] = 0.025f;
+        moving[i] = 0.f;
+        owner[i] = nullptr;
+    }
+
+    void release(int i) {
+        moving[i] = 0.f;
+        owner[i] = nullptr;
+        freeSlots.push_back(i);
+    }
+
+    void copy(int from, int to) {
+        speed[to] = speed[from];
+        betweenMoves[to] = betweenMoves[from];
+        sinceMove[to] = sinceMove[from];
+    }
+
+    // Safe from the think phase as long as i is your own slot
+    void request(int i, Entity* e, const glm::vec2& target) {
+        owner[i] = e;
+        x[i] = e->position.x;
+        y[i] = e->position.y;
+        targetX[i] = target.x;
+        targetY[i] = target.y;
+        moving[i] = 1.f;
+    }
+
+    // Steps slots [first, last) that asked to move, same lerp the agents
+    // used to do themselves once every betweenMoves seconds
+    void integrate(float dt, int first, int last) {
+        step(dt, last - first, x.data() + first, y.data() + first,
+             targetX.data() + first, targetY.data() + first,
+             speed.data() + first, betweenMoves.data() + first,
+             sinceMove.data() + first, moving.data() + first);
+
+        for (int i = first; i < last; i++) {
+            if (moving[i] == 0.f) continue;
+            owner[i]->position = glm::vec2{x[i], y[i]};
+            moving[i] = 0.f;
+        }
+    }
+
+    // Kept apart from the vectors so the compiler knows nothing overlaps
+    // and can vectorize it, moving comes back as 1 for whoever moved
+    static void step(float dt, int n, float* __restrict px,
+                     float* __restrict py, const float* __restrict tx,
+                     const float* __restrict ty, const float* __restrict sp,
+                     const float* __restrict between,
+                     float* __restrict since, float* __restrict mv) {
+        for (int i = 0; i < n; i++) {
+            float s = since[i] + dt * mv[i];
+            float moved = s >= between[i] ? mv[i] : 0.f;
+            float t = sp[i] * moved;
+            px[i] += (tx[i] - px[i]) * t;
+            py[i] += (ty[i] - py[i]) * t;
+            since[i] = moved > 0.f ? 0.f : s;
+            mv[i] = moved;
+        }
+    }
+
+    void integrate(float dt) { integrate(dt, 0, size()); }
+};
+
+// What a MovableEntity holds, a copy gets its own slot
+struct MovementSlot {
+    int index;
+
+    MovementSlot() : index(MovementStore::get().alloc()) {}
+    MovementSlot(const MovementSlot& other)
+        : index(MovementStore::get().alloc()) {
+        MovementStore::get().copy(other.index, index);
+    }
+    MovementSlot& operator=(const MovementSlot& other) {
+        if (this != &other) MovementStore::get().copy(other.index, index);
+        return *this;
+    }
+    ~MovementSlot() { MovementStore::get().release(index); }
+};
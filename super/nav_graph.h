@@ -0,0 +1,111 @@
+
+#pragma once
+
+#include <unordered_set>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Abstract graph used by PathHierarchy, lives on every OccupancyGrid::Layer.
+//
+// The floor is split into nav cells (STRIDE x STRIDE occupancy sub tiles)
+// and those into square clusters of CLUSTER x CLUSTER nav cells. Each
+// cluster knows where you can cross into its neighbors (entrances) and what
+// it costs to get between them, so a path search only has to look at the
+// inside of the clusters at either end.
+
+// A nav cell on the edge of a cluster you can step across the border from
+struct NavEntrance {
+    // absolute nav cell
+    int x;
+    int y;
+    // cells on the other side we connect to, more than one if we are in a
+    // corner (or the cluster got clipped down to a single cell)
+    int numLinks = 0;
+    int linkX[4];
+    int linkY[4];
+};
+
+struct NavCluster {
+    std::vector<NavEntrance> entrances;
+    // entrances x entrances, cost to walk between them without leaving the
+    // cluster (infinity if you cant)
+    std::vector<float> dist;
+
+    float cost(int a, int b) const {
+        return dist[a * entrances.size() + b];
+    }
+
+    int find(int x, int y) const {
+        for (size_t i = 0; i < entrances.size(); i++) {
+            if (entrances[i].x == x && entrances[i].y == y) return (int)i;
+        }
+        return -1;
+    }
+};
+
+struct NavGraph {
+    static constexpr int STRIDE = 2;
+    static constexpr int CLUSTER = 32;
+
+    // built clusters are never changed, only replaced, so copies of the
+    // grid (see PathService::snapshotFor) can share them
+    std::unordered_map<uint64_t, std::shared_ptr<const NavCluster>> clusters;
+    // clusters that need to be rebuilt before the next search
+    std::unordered_set<uint64_t> dirty;
+    // everything needs to be rebuilt
+    bool stale = true;
+
+    static uint64_t key(int cx, int cy) {
+        return ((uint64_t)(uint32_t)cx << 32) | (uint64_t)(uint32_t)cy;
+    }
+
+    static int floorDiv(int v, int d) {
+        return v >= 0 ? v / d : -((-v + d - 1) / d);
+    }
+
+    static int toNav(int subTile) { return floorDiv(subTile, STRIDE); }
+    static int toCluster(int nav) { return floorDiv(nav, CLUSTER); }
+
+    bool ready() const { return !stale && dirty.empty(); }
+
+    void markAll() {
+        stale = true;
+        dirty.clear();
+    }
+
+    // Sub tiles x0..x1, y0..y1 (inclusive) changed. Entrances depend on the
+    // cells just across the border too so we take the neighbors with us
+    void markDirty(int x0, int y0, int x1, int y1) {
+        if (stale) return;
+        int cx0 = toCluster(toNav(x0) - 1);
+        int cy0 = toCluster(toNav(y0) - 1);
+        int cx1 = toCluster(toNav(x1) + 1);
+        int cy1 = toCluster(toNav(y1) + 1);
+        for (int cx = cx0; cx <= cx1; cx++) {
+            for (int cy = cy0; cy <= cy1; cy++) {
+                dirty.insert(key(cx, cy));
+            }
+        }
+    }
+
+    // The grid grew from old to now (sub tiles, inclusive). Clusters on the
+    // old edge got new neighbors and everything past it is new
+    void markGrown(int oldX0, int oldY0, int oldX1, int oldY1, int x0, int y0,
+                   int x1, int y1) {
+        if (stale) return;
+        int ox0 = toNav(oldX0);
+        int oy0 = toNav(oldY0);
+        int ox1 = toNav(oldX1);
+        int oy1 = toNav(oldY1);
+        for (int cx = toCluster(toNav(x0)); cx <= toCluster(toNav(x1)); cx++) {
+            for (int cy = toCluster(toNav(y0)); cy <= toCluster(toNav(y1));
+                 cy++) {
+                bool inside = cx * CLUSTER - 1 >= ox0 &&
+                              cx * CLUSTER + CLUSTER <= ox1 &&
+                              cy * CLUSTER - 1 >= oy0 &&
+                              cy * CLUSTER + CLUSTER <= oy1;
+                if (!inside) dirty.insert(key(cx, cy));
+            }
+        }
+    }
+};
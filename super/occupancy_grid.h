@@ -0,0 +1,292 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/entity.h"
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "nav_graph.h"
+
+// Bit packed version of EntityHelper::isWalkable.
+//
+// The floor is split into sub tiles of `resolution` world units and every
+// agent size gets its own layer where each furniture box has already been
+// grown by the agent size (the agent is walkable at pos if its box
+// [pos, pos + size] doesnt touch any furniture). That turns a walkable check
+// into a single bit lookup instead of a scan over every entity.
+//
+// Cells are marked blocked if any point inside them would be blocked, so the
+// grid is slightly more conservative than the exact check (by at most one
+// sub tile)
+struct OccupancyGrid {
+    struct Layer {
+        // agent size in sub tiles, (0,0) is the raw furniture footprint
+        int inflateX;
+        int inflateY;
+        std::vector<uint64_t> bits;
+        // clusters for PathHierarchy, only marked dirty here
+        NavGraph nav;
+    };
+
+    // how far past the furniture the grid extends, agents larger than this
+    // will not be fully inflated at the edges
+    static constexpr int PADDING_TILES = 4;
+    // grid grows in chunks of this many tiles so we dont rebuild every drag
+    static constexpr int GROW_TILES = 16;
+
+    float resolution;
+    // in sub tiles
+    int originX = 0;
+    int originY = 0;
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    // bumped on every change so copies (see PathService) know they are stale
+    int version = 0;
+
+    // entity id -> footprint (minx, miny, maxx, maxy) in world units
+    std::unordered_map<int, glm::vec4> furniture;
+    // keyed on quantized agent size, std::map so Layer* stays valid
+    std::map<std::pair<int, int>, Layer> layers;
+
+    explicit OccupancyGrid(float res = 0.125f) : resolution(res) {}
+
+    bool empty() const { return furniture.empty(); }
+
+    int toCell(float v) const { return (int)std::floor(v / resolution); }
+
+    // rounds up so the layer always covers the whole agent, the small
+    // nudge keeps sizes that are already a multiple from going up one
+    std::pair<int, int> layerKey(const glm::vec2& agentSize) const {
+        return {(int)std::ceil(std::abs(agentSize.x) / resolution - 1e-4f),
+                (int)std::ceil(std::abs(agentSize.y) / resolution - 1e-4f)};
+    }
+
+    Layer& layerFor(const glm::vec2& agentSize) {
+        auto key = layerKey(agentSize);
+        auto it = layers.find(key);
+        if (it != layers.end()) return it->second;
+
+        if (key.first > PADDING_TILES / resolution ||
+            key.second > PADDING_TILES / resolution) {
+            log_warn("agent size {} is larger than the occupancy padding",
+                     agentSize.x);
+        }
+        Layer& layer = layers[key];
+        layer.inflateX = key.first;
+        layer.inflateY = key.second;
+        rasterize(layer);
+        version++;
+        return layer;
+    }
+
+    // Doesnt create the layer, safe to call on a shared read only copy
+    const Layer* findLayer(const glm::vec2& agentSize) const {
+        auto it = layers.find(layerKey(agentSize));
+        return it == layers.end() ? nullptr : &it->second;
+    }
+
+    bool test(const Layer& layer, const glm::vec2& pos) const {
+        int x = toCell(pos.x) - originX;
+        int y = toCell(pos.y) - originY;
+        // nothing has been placed out there
+        if (x < 0 || y < 0 || x >= width || y >= height) return false;
+        return (layer.bits[y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+    }
+
+    bool isWalkable(const glm::vec2& pos, const glm::vec2& agentSize) {
+        if (empty()) return true;
+        return !test(layerFor(agentSize), pos);
+    }
+
+    // Same but never builds a layer, so it is safe from the think phase
+    // (see EntityUpdater). A size nobody has searched a path for yet has no
+    // layer and counts as walkable
+    bool isWalkableReadOnly(const glm::vec2& pos,
+                            const glm::vec2& agentSize) const {
+        if (empty()) return true;
+        const Layer* layer = findLayer(agentSize);
+        return !layer || !test(*layer, pos);
+    }
+
+    void add(int id, const glm::vec2& pos, const glm::vec2& sz) {
+        glm::vec2 lo = glm::min(pos, pos + sz);
+        glm::vec2 hi = glm::max(pos, pos + sz);
+        glm::vec4 box = {lo.x, lo.y, hi.x, hi.y};
+
+        furniture[id] = box;
+        version++;
+        if (!covers(box)) {
+            grow(box);  // grow already rasterized everything
+        } else {
+            for (auto& kv : layers) stamp(kv.second, box, true);
+        }
+        for (auto& kv : layers) markChanged(kv.second, box);
+    }
+
+    void remove(int id) {
+        auto it = furniture.find(id);
+        if (it == furniture.end()) return;
+        glm::vec4 box = it->second;
+        furniture.erase(it);
+        version++;
+
+        for (auto& kv : layers) {
+            Layer& layer = kv.second;
+            stamp(layer, box, false);
+            markChanged(layer, box);
+            // anything overlapping the area we just cleared needs to be put
+            // back since bits dont know who set them
+            glm::vec4 area = inflate(layer, box);
+            for (auto& f : furniture) {
+                glm::vec4 other = inflate(layer, f.second);
+                if (other.x < area.z && other.z > area.x &&  //
+                    other.y < area.w && other.w > area.y) {
+                    stamp(layer, f.second, true);
+                }
+            }
+        }
+    }
+
+    void clear() {
+        furniture.clear();
+        layers.clear();
+        originX = originY = width = height = wordsPerRow = 0;
+        version++;
+    }
+
+    // region an agent of this layer's size cant stand in
+    glm::vec4 inflate(const Layer& layer, const glm::vec4& box) const {
+        return {box.x - layer.inflateX * resolution,
+                box.y - layer.inflateY * resolution, box.z, box.w};
+    }
+
+    bool covers(const glm::vec4& box) const {
+        int pad = (int)(PADDING_TILES / resolution);
+        return width > 0 &&                              //
+               toCell(box.x) - pad >= originX &&         //
+               toCell(box.y) - pad >= originY &&         //
+               toCell(box.z) + pad < originX + width &&  //
+               toCell(box.w) + pad < originY + height;
+    }
+
+    void grow(const glm::vec4& box) {
+        int chunk = (int)(GROW_TILES / resolution);
+        int pad = (int)(PADDING_TILES / resolution);
+        auto roundDown = [&](int v) {
+            return (int)std::floor((float)v / chunk) * chunk;
+        };
+
+        int minX = toCell(box.x) - pad;
+        int minY = toCell(box.y) - pad;
+        int maxX = toCell(box.z) + pad;
+        int maxY = toCell(box.w) + pad;
+        int oldX = originX;
+        int oldY = originY;
+        int oldWidth = width;
+        int oldHeight = height;
+        if (width > 0) {
+            minX = std::min(minX, originX);
+            minY = std::min(minY, originY);
+            maxX = std::max(maxX, originX + width - 1);
+            maxY = std::max(maxY, originY + height - 1);
+        }
+        originX = roundDown(minX);
+        originY = roundDown(minY);
+        width = roundDown(maxX) + chunk - originX;
+        height = roundDown(maxY) + chunk - originY;
+        wordsPerRow = (width + 63) / 64;
+
+        for (auto& kv : layers) {
+            rasterize(kv.second);
+            if (oldWidth == 0) {
+                kv.second.nav.markAll();
+                continue;
+            }
+            kv.second.nav.markGrown(oldX, oldY, oldX + oldWidth - 1,
+                                    oldY + oldHeight - 1, originX, originY,
+                                    originX + width - 1, originY + height - 1);
+        }
+    }
+
+    void rasterize(Layer& layer) {
+        layer.bits.assign((size_t)wordsPerRow * height, 0);
+        for (auto& kv : furniture) stamp(layer, kv.second, true);
+    }
+
+    // Tells the nav graph which sub tiles box might have changed
+    void markChanged(Layer& layer, const glm::vec4& box) {
+        glm::vec4 area = inflate(layer, box);
+        layer.nav.markDirty(toCell(area.x), toCell(area.y),
+                            (int)std::ceil(area.z / resolution) - 1,
+                            (int)std::ceil(area.w / resolution) - 1);
+    }
+
+    void stamp(Layer& layer, const glm::vec4& box, bool blocked) {
+        glm::vec4 area = inflate(layer, box);
+        // blocked region is open on both ends so a cell ending exactly where
+        // it starts is still free
+        int x0 = std::max(toCell(area.x), originX) - originX;
+        int y0 = std::max(toCell(area.y), originY) - originY;
+        int x1 = std::min((int)std::ceil(area.z / resolution) - 1,
+                          originX + width - 1) -
+                 originX;
+        int y1 = std::min((int)std::ceil(area.w / resolution) - 1,
+                          originY + height - 1) -
+                 originY;
+
+        for (int y = y0; y <= y1; y++) {
+            uint64_t* row = &layer.bits[(size_t)y * wordsPerRow];
+            for (int x = x0; x <= x1;) {
+                int word = x >> 6;
+                int first = x & 63;
+                int last = std::min(63, x1 - (word << 6));
+                uint64_t mask = ~0ull << first;
+                if (last < 63) mask &= (1ull << (last + 1)) - 1;
+                if (blocked) {
+                    row[word] |= mask;
+                } else {
+                    row[word] &= ~mask;
+                }
+                x = (word + 1) << 6;
+            }
+        }
+    }
+};
+
+// Functor version of isWalkable for a single agent size, resolves the layer
+// once so the path search only pays for the bit lookup per node
+struct Walkable {
+    const OccupancyGrid* grid;
+    const OccupancyGrid::Layer* layer;
+
+    bool operator()(const glm::vec2& pos) const {
+        return !grid->test(*layer, pos);
+    }
+};
+
+static OccupancyGrid occupancyGrid_DO_NOT_USE;
+
+struct Occupancy {
+    static OccupancyGrid& grid() { return occupancyGrid_DO_NOT_USE; }
+
+    static bool isWalkable(const glm::vec2& pos, const glm::vec2& size) {
+        return grid().isWalkable(pos, size);
+    }
+
+    static bool isWalkableReadOnly(const glm::vec2& pos,
+                                   const glm::vec2& size) {
+        return grid().isWalkableReadOnly(pos, size);
+    }
+
+    static Walkable walkable(const glm::vec2& size) {
+        return Walkable{&grid(), &grid().layerFor(size)};
+    }
+
+    // Registered with SpatialIndex::addLayoutListener
+    static void onLayoutChanged(const std::shared_ptr<Entity>& e, bool added) {
+        if (added) {
+            grid().add(e->id, e->position, e->size);
+        } else {
+            grid().remove(e->id);
+        }
+    }
+};
@@ -0,0 +1,197 @@
+
+#pragma once
+
+#include <list>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Finished paths are never changed once made so the cache, the request and
+// every agent following one can all share the same points
+typedef std::shared_ptr<const std::vector<glm::vec2>> SharedPath;
+
+inline SharedPath makeSharedPath(std::vector<glm::vec2> points) {
+    return std::make_shared<const std::vector<glm::vec2>>(std::move(points));
+}
+
+// Where an agent is along a SharedPath. Reaching a waypoint just moves the
+// cursor, nothing is copied or erased
+struct PathCursor {
+    SharedPath points;
+    // where this agent is actually going, a path out of the PathCache can
+    // end a little off since close enough ends share one
+    glm::vec2 finish;
+    int next = 0;
+
+    PathCursor() {}
+    PathCursor(SharedPath p, const glm::vec2& f)
+        : points(std::move(p)), finish(f) {}
+
+    bool empty() const { return !points || next >= (int)points->size(); }
+    // waypoints left
+    int size() const { return empty() ? 0 : (int)points->size() - next; }
+
+    // i-th waypoint from here
+    glm::vec2 operator[](int i) const {
+        int at = next + i;
+        return at + 1 == (int)points->size() ? finish : (*points)[at];
+    }
+    glm::vec2 front() const { return (*this)[0]; }
+
+    void pop() {
+        next++;
+        // let go as soon as we are done so the cache can free it
+        if (empty()) clear();
+    }
+
+    void clear() {
+        points.reset();
+        next = 0;
+    }
+};
+
+struct PathKey {
+    int startX;
+    int startY;
+    int endX;
+    int endY;
+    int sizeX;
+    int sizeY;
+
+    bool operator==(const PathKey& o) const {
+        return startX == o.startX && startY == o.startY && endX == o.endX &&
+               endY == o.endY && sizeX == o.sizeX && sizeY == o.sizeY;
+    }
+};
+
+struct PathKeyHash {
+    size_t operator()(const PathKey& k) const {
+        size_t h = 0;
+        for (int v : {k.startX, k.startY, k.endX, k.endY, k.sizeX, k.sizeY}) {
+            h = h * 31 + std::hash<int>()(v);
+        }
+        return h;
+    }
+};
+
+// LRU of finished paths keyed on start / end snapped to a coarse grid, most
+// customers walk from the same spawn area to the same few shelves so we
+// dont need to search for those every time.
+//
+// When furniture is placed or removed only the paths that pass near it are
+// dropped, paths elsewhere in the store stay (they might not be the shortest
+// anymore after a removal but they are still walkable)
+struct PathCache {
+    struct Entry {
+        PathKey key;
+        SharedPath path;
+        // everything the agent touches while following the path
+        // (minx, miny, maxx, maxy)
+        glm::vec4 bounds;
+    };
+
+    // start and end within this distance share a path
+    static constexpr float QUANTUM = 0.5f;
+
+    size_t capacity;
+    // most recently used at the front
+    std::list<Entry> entries;
+    std::unordered_map<PathKey, std::list<Entry>::iterator, PathKeyHash>
+        lookup;
+
+    int hits = 0;
+    int misses = 0;
+    int evicted = 0;
+    int invalidated = 0;
+
+    explicit PathCache(size_t cap = 1024) : capacity(cap) {}
+
+    static PathKey keyFor(const glm::vec2& start, const glm::vec2& end,
+                          const glm::vec2& size) {
+        auto q = [](float v) { return (int)std::floor(v / QUANTUM); };
+        // agent sizes are matched the same way the occupancy layers are
+        auto s = [](float v) {
+            return (int)std::ceil(std::abs(v) * 8.f - 1e-4f);
+        };
+        return {q(start.x), q(start.y), q(end.x),
+                q(end.y),   s(size.x),  s(size.y)};
+    }
+
+    size_t size() const { return entries.size(); }
+
+    float hitRate() const {
+        int total = hits + misses;
+        return total == 0 ? 0.f : (float)hits / total;
+    }
+
+    void resetStats() { hits = misses = evicted = invalidated = 0; }
+
+    // for a path get() found that turned out to be no good
+    void countAsMiss() {
+        hits--;
+        misses++;
+    }
+
+    // Returns nullptr on a miss, the path stays good even if it gets evicted
+    SharedPath get(const glm::vec2& start, const glm::vec2& end,
+                   const glm::vec2& size) {
+        auto it = lookup.find(keyFor(start, end, size));
+        if (it == lookup.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->path;
+    }
+
+    void put(const glm::vec2& start, const glm::vec2& end,
+             const glm::vec2& size, const SharedPath& path) {
+        // no path could mean the store is blocked off right now,
+        // dont remember that
+        if (!path || path->empty()) return;
+
+        PathKey key = keyFor(start, end, size);
+        auto it = lookup.find(key);
+        if (it != lookup.end()) {
+            entries.erase(it->second);
+            lookup.erase(it);
+        }
+
+        glm::vec2 lo = start;
+        glm::vec2 hi = start;
+        for (auto& p : *path) {
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        hi = hi + glm::abs(size);
+
+        entries.push_front(Entry{key, path, glm::vec4{lo.x, lo.y, hi.x, hi.y}});
+        lookup[key] = entries.begin();
+
+        while (entries.size() > capacity) {
+            lookup.erase(entries.back().key);
+            entries.pop_back();
+            evicted++;
+        }
+    }
+
+    // Drop any path that goes through box (minx, miny, maxx, maxy)
+    void invalidate(const glm::vec4& box) {
+        auto it = entries.begin();
+        while (it != entries.end()) {
+            const glm::vec4& b = it->bounds;
+            if (b.x < box.z && b.z > box.x && b.y < box.w && b.w > box.y) {
+                lookup.erase(it->key);
+                it = entries.erase(it);
+                invalidated++;
+            } else {
+                it++;
+            }
+        }
+    }
+
+    void clear() {
+        entries.clear();
+        lookup.clear();
+    }
+};
@@ -0,0 +1,527 @@
+
+#pragma once
+
+#include <queue>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "nav_graph.h"
+#include "occupancy_grid.h"
+
+// Hierarchical path search (HPA*) over the occupancy grid.
+//
+// A search first runs over the abstract graph in NavGraph (cluster entrances
+// and the cost between them) and only then looks at actual cells, one
+// cluster at a time, for the clusters on the route. There are no fixed
+// bounds, the graph covers whatever the occupancy grid covers, and the cost
+// grows with the length of the route instead of the size of the store.
+//
+// Nav cells are only open if every sub tile in them is, paths go through
+// cell centers and get straightened with a line of sight check at the end
+struct PathHierarchy {
+    static constexpr float INF = std::numeric_limits<float>::max();
+    static constexpr float DIAGONAL = 1.41421f;
+    // open stretches of border shorter than this get one entrance in the
+    // middle, longer ones get one at each end
+    static constexpr int WIDE_ENTRANCE = 6;
+    // heuristics get scaled by this so of all the equally short routes we
+    // follow the one heading at the goal instead of trying all of them
+    static constexpr float TIE_BREAK = 1.001f;
+    static constexpr int NEIGHBORS[8][2] = {
+        {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1},
+    };
+
+    // inclusive, in nav cells
+    struct Rect {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+
+        int width() const { return x1 - x0 + 1; }
+        int height() const { return y1 - y0 + 1; }
+        bool empty() const { return x1 < x0 || y1 < y0; }
+        bool contains(int x, int y) const {
+            return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+        }
+        Rect intersect(const Rect& o) const {
+            return {std::max(x0, o.x0), std::max(y0, o.y0),
+                    std::min(x1, o.x1), std::min(y1, o.y1)};
+        }
+    };
+
+    // Which nav cells in rect are open, copied out once so the searches
+    // dont keep going back to the bits
+    struct Patch {
+        Rect rect;
+        std::vector<uint8_t> open;
+
+        int indexOf(int x, int y) const {
+            return (y - rect.y0) * rect.width() + (x - rect.x0);
+        }
+        int xOf(int index) const { return rect.x0 + index % rect.width(); }
+        int yOf(int index) const { return rect.y0 + index / rect.width(); }
+
+        bool isOpen(int x, int y) const {
+            return rect.contains(x, y) && open[indexOf(x, y)];
+        }
+    };
+
+    static float octile(int dx, int dy) {
+        float ax = (float)std::abs(dx);
+        float ay = (float)std::abs(dy);
+        return std::max(ax, ay) + (DIAGONAL - 1.f) * std::min(ax, ay);
+    }
+
+    static uint64_t cellKey(int x, int y) { return NavGraph::key(x, y); }
+    static int keyX(uint64_t k) { return (int)(int32_t)(k >> 32); }
+    static int keyY(uint64_t k) { return (int)(int32_t)(k & 0xffffffff); }
+
+    // nav cells the grid covers, the graph doesnt go past this
+    static Rect domain(const OccupancyGrid& grid) {
+        return {NavGraph::toNav(grid.originX), NavGraph::toNav(grid.originY),
+                NavGraph::toNav(grid.originX + grid.width - 1),
+                NavGraph::toNav(grid.originY + grid.height - 1)};
+    }
+
+    static Rect clusterRect(const Rect& dom, int cx, int cy) {
+        int c = NavGraph::CLUSTER;
+        return Rect{cx * c, cy * c, cx * c + c - 1, cy * c + c - 1}.intersect(
+            dom);
+    }
+
+    static bool navBlocked(const OccupancyGrid& grid,
+                           const OccupancyGrid::Layer& layer, int nx, int ny) {
+        int s = NavGraph::STRIDE;
+        for (int sy = 0; sy < s; sy++) {
+            int y = ny * s + sy - grid.originY;
+            if (y < 0 || y >= grid.height) continue;
+            const uint64_t* row = &layer.bits[(size_t)y * grid.wordsPerRow];
+            for (int sx = 0; sx < s; sx++) {
+                int x = nx * s + sx - grid.originX;
+                if (x < 0 || x >= grid.width) continue;
+                if ((row[x >> 6] >> (x & 63)) & 1) return true;
+            }
+        }
+        return false;
+    }
+
+    static Patch patchFor(const OccupancyGrid& grid,
+                          const OccupancyGrid::Layer& layer, const Rect& r) {
+        Patch patch;
+        patch.rect = r.intersect(domain(grid));
+        if (patch.rect.empty()) return patch;
+        patch.open.resize((size_t)patch.rect.width() * patch.rect.height());
+        for (int y = patch.rect.y0; y <= patch.rect.y1; y++) {
+            for (int x = patch.rect.x0; x <= patch.rect.x1; x++) {
+                patch.open[patch.indexOf(x, y)] =
+                    !navBlocked(grid, layer, x, y);
+            }
+        }
+        return patch;
+    }
+
+    // Dijkstra from (sx, sy) over the open cells of patch that are inside
+    // area. cost and parent are indexed like patch.open. With a target (a
+    // patch index) it turns into A* and stops once the target is settled
+    static void search(const Patch& patch, const Rect& area, int sx, int sy,
+                       std::vector<float>& cost, std::vector<int>& parent,
+                       int target = -1) {
+        cost.assign(patch.open.size(), INF);
+        parent.assign(patch.open.size(), -1);
+        auto passable = [&](int x, int y) {
+            return area.contains(x, y) && patch.isOpen(x, y);
+        };
+        if (!passable(sx, sy)) return;
+
+        int tx = target < 0 ? 0 : patch.xOf(target);
+        int ty = target < 0 ? 0 : patch.yOf(target);
+        auto h = [&](int x, int y) {
+            return target < 0 ? 0.f : octile(x - tx, y - ty) * TIE_BREAK;
+        };
+
+        typedef std::pair<float, int> Item;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+        int startIndex = patch.indexOf(sx, sy);
+        cost[startIndex] = 0.f;
+        open.push({h(sx, sy), startIndex});
+        while (!open.empty()) {
+            auto [f, index] = open.top();
+            open.pop();
+            if (index == target) return;
+            int x = patch.xOf(index);
+            int y = patch.yOf(index);
+            float c = cost[index];
+            if (f > c + h(x, y)) continue;
+            for (int i = 0; i < 8; i++) {
+                int nx = x + NEIGHBORS[i][0];
+                int ny = y + NEIGHBORS[i][1];
+                if (!passable(nx, ny)) continue;
+                float step = 1.f;
+                if (i >= 4) {
+                    // dont cut corners
+                    if (!passable(nx, y) || !passable(x, ny)) continue;
+                    step = DIAGONAL;
+                }
+                int next = patch.indexOf(nx, ny);
+                if (c + step < cost[next]) {
+                    cost[next] = c + step;
+                    parent[next] = index;
+                    open.push({c + step + h(nx, ny), next});
+                }
+            }
+        }
+    }
+
+    static std::shared_ptr<const NavCluster> buildCluster(
+        const OccupancyGrid& grid, const OccupancyGrid::Layer& layer,
+        const Rect& dom, int cx, int cy) {
+        auto cluster = std::make_shared<NavCluster>();
+        Rect r = clusterRect(dom, cx, cy);
+        if (r.empty()) return cluster;
+        // one extra ring so we can see across the borders
+        Patch patch =
+            patchFor(grid, layer, Rect{r.x0 - 1, r.y0 - 1, r.x1 + 1, r.y1 + 1});
+
+        auto link = [&](int x, int y, int lx, int ly) {
+            int i = cluster->find(x, y);
+            if (i < 0) {
+                cluster->entrances.push_back(NavEntrance{x, y});
+                i = (int)cluster->entrances.size() - 1;
+            }
+            NavEntrance& e = cluster->entrances[i];
+            e.linkX[e.numLinks] = lx;
+            e.linkY[e.numLinks] = ly;
+            e.numLinks++;
+        };
+
+        // Walks one border starting at (x, y), (dx, dy) points out of the
+        // cluster. The neighbor walks the same border from its side and
+        // ends up with the same entrances
+        auto scan = [&](int x, int y, int stepX, int stepY, int len, int dx,
+                        int dy) {
+            int runStart = -1;
+            for (int i = 0; i <= len; i++) {
+                int ix = x + stepX * i;
+                int iy = y + stepY * i;
+                bool open = i < len && patch.isOpen(ix, iy) &&
+                            patch.isOpen(ix + dx, iy + dy);
+                if (open && runStart < 0) runStart = i;
+                if (open || runStart < 0) continue;
+
+                auto add = [&](int j) {
+                    int jx = x + stepX * j;
+                    int jy = y + stepY * j;
+                    link(jx, jy, jx + dx, jy + dy);
+                };
+                int runEnd = i - 1;
+                if (runEnd - runStart + 1 < WIDE_ENTRANCE) {
+                    add((runStart + runEnd) / 2);
+                } else {
+                    add(runStart);
+                    add(runEnd);
+                }
+                runStart = -1;
+            }
+        };
+        scan(r.x0, r.y0, 0, 1, r.height(), -1, 0);
+        scan(r.x1, r.y0, 0, 1, r.height(), 1, 0);
+        scan(r.x0, r.y0, 1, 0, r.width(), 0, -1);
+        scan(r.x0, r.y1, 1, 0, r.width(), 0, 1);
+
+        size_t n = cluster->entrances.size();
+        cluster->dist.assign(n * n, INF);
+        std::vector<float> cost;
+        std::vector<int> parent;
+        for (size_t i = 0; i < n; i++) {
+            const NavEntrance& from = cluster->entrances[i];
+            search(patch, r, from.x, from.y, cost, parent);
+            for (size_t j = 0; j < n; j++) {
+                const NavEntrance& to = cluster->entrances[j];
+                cluster->dist[i * n + j] = cost[patch.indexOf(to.x, to.y)];
+            }
+        }
+        return cluster;
+    }
+
+    static void refresh(const OccupancyGrid& grid, OccupancyGrid::Layer& layer) {
+        NavGraph& nav = layer.nav;
+        if (nav.ready()) return;
+
+        Rect dom = domain(grid);
+        int cx0 = NavGraph::toCluster(dom.x0);
+        int cy0 = NavGraph::toCluster(dom.y0);
+        int cx1 = NavGraph::toCluster(dom.x1);
+        int cy1 = NavGraph::toCluster(dom.y1);
+        if (nav.stale) {
+            nav.clusters.clear();
+            if (grid.width > 0) {
+                for (int cx = cx0; cx <= cx1; cx++) {
+                    for (int cy = cy0; cy <= cy1; cy++) {
+                        nav.clusters[NavGraph::key(cx, cy)] =
+                            buildCluster(grid, layer, dom, cx, cy);
+                    }
+                }
+            }
+        } else {
+            for (uint64_t k : nav.dirty) {
+                int cx = keyX(k);
+                int cy = keyY(k);
+                if (cx < cx0 || cx > cx1 || cy < cy0 || cy > cy1) continue;
+                nav.clusters[k] = buildCluster(grid, layer, dom, cx, cy);
+            }
+        }
+        nav.stale = false;
+        nav.dirty.clear();
+    }
+
+    // Rebuilds the clusters that changed since the last call, has to run on
+    // the main thread before the grid gets copied for the workers
+    static void refresh(OccupancyGrid& grid) {
+        for (auto& kv : grid.layers) refresh(grid, kv.second);
+    }
+
+    // Agents can move anywhere inside an open sub tile so sampling twice per
+    // sub tile is enough
+    static bool lineOfSight(const OccupancyGrid& grid,
+                            const OccupancyGrid::Layer& layer,
+                            const glm::vec2& a, const glm::vec2& b) {
+        int steps =
+            (int)std::ceil(glm::distance(a, b) / (grid.resolution * 0.5f));
+        for (int i = 0; i <= steps; i++) {
+            float t = steps == 0 ? 0.f : (float)i / steps;
+            if (grid.test(layer, a + (b - a) * t)) return false;
+        }
+        return true;
+    }
+
+    // Moves (x, y) to the closest open cell in the patch, false if there
+    // isnt one
+    static bool nearestOpen(const Patch& patch, int& x, int& y) {
+        if (patch.isOpen(x, y)) return true;
+        int best = -1;
+        int bestDist = std::numeric_limits<int>::max();
+        for (size_t i = 0; i < patch.open.size(); i++) {
+            if (!patch.open[i]) continue;
+            int dx = patch.xOf((int)i) - x;
+            int dy = patch.yOf((int)i) - y;
+            if (dx * dx + dy * dy < bestDist) {
+                bestDist = dx * dx + dy * dy;
+                best = (int)i;
+            }
+        }
+        if (best < 0) return false;
+        x = patch.xOf(best);
+        y = patch.yOf(best);
+        return true;
+    }
+
+    // cells from index back to wherever the search started
+    static void walkBack(const Patch& patch, const std::vector<int>& parent,
+                         int index,
+                         std::vector<std::pair<int, int>>& cells) {
+        for (; index >= 0; index = parent[index]) {
+            cells.push_back({patch.xOf(index), patch.yOf(index)});
+        }
+    }
+
+    // Path from start to end (both included) for the agent size the layer
+    // was built for, empty if there isnt one
+    static std::vector<glm::vec2> findPath(const OccupancyGrid& grid,
+                                           const OccupancyGrid::Layer& layer,
+                                           const glm::vec2& start,
+                                           const glm::vec2& end,
+                                           bool elideLineOfSight = true) {
+        // nothing placed yet, everything is open
+        if (grid.width == 0) return {start, end};
+        if (elideLineOfSight && lineOfSight(grid, layer, start, end)) {
+            return {start, end};
+        }
+        const NavGraph& nav = layer.nav;
+        if (!nav.ready()) {
+            log_warn("path search on a stale nav graph, missing a refresh");
+            return {};
+        }
+
+        // anything outside the grid is open so just walk in from the edge
+        Rect dom = domain(grid);
+        auto navCell = [&](const glm::vec2& p) {
+            return std::pair<int, int>{
+                std::clamp(NavGraph::toNav(grid.toCell(p.x)), dom.x0, dom.x1),
+                std::clamp(NavGraph::toNav(grid.toCell(p.y)), dom.y0, dom.y1),
+            };
+        };
+        auto [sx, sy] = navCell(start);
+        auto [gx, gy] = navCell(end);
+        int scx = NavGraph::toCluster(sx);
+        int scy = NavGraph::toCluster(sy);
+        int gcx = NavGraph::toCluster(gx);
+        int gcy = NavGraph::toCluster(gy);
+        auto sIt = nav.clusters.find(NavGraph::key(scx, scy));
+        auto gIt = nav.clusters.find(NavGraph::key(gcx, gcy));
+        if (sIt == nav.clusters.end() || gIt == nav.clusters.end()) return {};
+        const NavCluster& sCluster = *sIt->second;
+        bool sameCluster = scx == gcx && scy == gcy;
+
+        // the goal is usually inside a shelf, go to the closest open spot
+        Rect sRect = clusterRect(dom, scx, scy);
+        Rect gRect = clusterRect(dom, gcx, gcy);
+        Patch sPatch = patchFor(grid, layer, sRect);
+        Patch gPatch = patchFor(grid, layer, gRect);
+        if (!nearestOpen(sPatch, sx, sy) || !nearestOpen(gPatch, gx, gy)) {
+            return {};
+        }
+
+        std::vector<float> sCost, gCost;
+        std::vector<int> sParent, gParent;
+        search(sPatch, sRect, sx, sy, sCost, sParent);
+        search(gPatch, gRect, gx, gy, gCost, gParent);
+
+        // A* over the entrances, start and goal hook into the entrances of
+        // their own cluster. Every key is a valid cell so the start and goal
+        // are flags instead of keys
+        struct Node {
+            float g;
+            uint64_t parent;
+            bool fromStart;
+        };
+        std::unordered_map<uint64_t, Node> nodes;
+        nodes.reserve(4096);
+        Node goal = {INF, 0, false};
+        // (f, key, is the goal)
+        typedef std::tuple<float, uint64_t, bool> Item;
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+
+        auto h = [&](int x, int y) {
+            return octile(x - gx, y - gy) * TIE_BREAK;
+        };
+        auto relax = [&](uint64_t k, int x, int y, float g, uint64_t from,
+                         bool fromStart) {
+            auto [it, added] = nodes.try_emplace(k, Node{g, from, fromStart});
+            if (!added) {
+                if (it->second.g <= g) return;
+                it->second = Node{g, from, fromStart};
+            }
+            open.push({g + h(x, y), k, false});
+        };
+        auto relaxGoal = [&](float g, uint64_t from, bool fromStart) {
+            if (goal.g <= g) return;
+            goal = Node{g, from, fromStart};
+            open.push({g, 0, true});
+        };
+
+        for (const NavEntrance& e : sCluster.entrances) {
+            float c = sCost[sPatch.indexOf(e.x, e.y)];
+            if (c < INF) relax(cellKey(e.x, e.y), e.x, e.y, c, 0, true);
+        }
+        if (sameCluster) {
+            float c = sCost[sPatch.indexOf(gx, gy)];
+            if (c < INF) relaxGoal(c, 0, true);
+        }
+
+        while (!open.empty()) {
+            auto [f, k, isGoal] = open.top();
+            open.pop();
+            if (isGoal) break;
+            int x = keyX(k);
+            int y = keyY(k);
+            float g = nodes[k].g;
+            if (f > g + h(x, y)) continue;
+
+            int cx = NavGraph::toCluster(x);
+            int cy = NavGraph::toCluster(y);
+            auto it = nav.clusters.find(NavGraph::key(cx, cy));
+            if (it == nav.clusters.end()) continue;
+            const NavCluster& cluster = *it->second;
+            int i = cluster.find(x, y);
+            if (i < 0) continue;
+
+            if (cx == gcx && cy == gcy) {
+                float c = gCost[gPatch.indexOf(x, y)];
+                if (c < INF) relaxGoal(g + c, k, false);
+            }
+            for (size_t j = 0; j < cluster.entrances.size(); j++) {
+                float c = cluster.cost(i, (int)j);
+                if ((int)j == i || c == INF) continue;
+                const NavEntrance& e = cluster.entrances[j];
+                relax(cellKey(e.x, e.y), e.x, e.y, g + c, k, false);
+            }
+            const NavEntrance& e = cluster.entrances[i];
+            for (int l = 0; l < e.numLinks; l++) {
+                relax(cellKey(e.linkX[l], e.linkY[l]), e.linkX[l], e.linkY[l],
+                      g + 1.f, k, false);
+            }
+        }
+        if (goal.g == INF) return {};
+
+        std::vector<uint64_t> chain;
+        for (Node n = goal; !n.fromStart; n = nodes[n.parent]) {
+            chain.push_back(n.parent);
+        }
+        std::reverse(chain.begin(), chain.end());
+
+        // now fill in the actual cells, one cluster at a time
+        std::vector<std::pair<int, int>> cells;
+        {
+            int tx = chain.empty() ? gx : keyX(chain.front());
+            int ty = chain.empty() ? gy : keyY(chain.front());
+            walkBack(sPatch, sParent, sPatch.indexOf(tx, ty), cells);
+            std::reverse(cells.begin(), cells.end());
+        }
+        std::vector<float> cost;
+        std::vector<int> parent;
+        std::vector<std::pair<int, int>> piece;
+        for (size_t i = 1; i < chain.size(); i++) {
+            int ax = keyX(chain[i - 1]);
+            int ay = keyY(chain[i - 1]);
+            int bx = keyX(chain[i]);
+            int by = keyY(chain[i]);
+            int cx = NavGraph::toCluster(ax);
+            int cy = NavGraph::toCluster(ay);
+            if (cx != NavGraph::toCluster(bx) || cy != NavGraph::toCluster(by)) {
+                // stepping across a border
+                cells.push_back({bx, by});
+                continue;
+            }
+            Rect r = clusterRect(dom, cx, cy);
+            Patch patch = patchFor(grid, layer, r);
+            search(patch, r, ax, ay, cost, parent, patch.indexOf(bx, by));
+            piece.clear();
+            walkBack(patch, parent, patch.indexOf(bx, by), piece);
+            cells.insert(cells.end(), piece.rbegin() + 1, piece.rend());
+        }
+        if (!chain.empty()) {
+            piece.clear();
+            walkBack(gPatch, gParent,
+                     gPatch.indexOf(keyX(chain.back()), keyY(chain.back())),
+                     piece);
+            cells.insert(cells.end(), piece.begin() + 1, piece.end());
+        }
+
+        // only keep the cells where we turn
+        float cellSize = grid.resolution * NavGraph::STRIDE;
+        std::vector<glm::vec2> points = {start};
+        for (size_t i = 0; i < cells.size(); i++) {
+            if (i > 0 && i + 1 < cells.size() &&
+                cells[i].first - cells[i - 1].first ==
+                    cells[i + 1].first - cells[i].first &&
+                cells[i].second - cells[i - 1].second ==
+                    cells[i + 1].second - cells[i].second)
+                continue;
+            points.push_back(glm::vec2{cells[i].first + 0.5f,
+                                       cells[i].second + 0.5f} *
+                             cellSize);
+        }
+        points.push_back(end);
+        if (!elideLineOfSight) return points;
+
+        std::vector<glm::vec2> path = {points.front()};
+        size_t anchor = 0;
+        for (size_t i = 2; i < points.size(); i++) {
+            if (lineOfSight(grid, layer, points[anchor], points[i])) continue;
+            anchor = i - 1;
+            path.push_back(points[anchor]);
+        }
+        path.push_back(points.back());
+        return path;
+    }
+};
@@ -0,0 +1,263 @@
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "occupancy_grid.h"
+#include "path_cache.h"
+#include "path_hierarchy.h"
+
+// walkable.grid has to have been refreshed (see PathHierarchy::refresh),
+// snapshots from PathService::snapshotFor always are
+inline std::vector<glm::vec2> findPath(const Walkable& walkable,
+                                       const glm::vec2& start,
+                                       const glm::vec2& end,
+                                       bool elideLineOfSight = true) {
+    return PathHierarchy::findPath(*walkable.grid, *walkable.layer, start,
+                                   end, elideLineOfSight);
+}
+
+struct PathRequest {
+    glm::vec2 start;
+    glm::vec2 end;
+    glm::vec2 size;
+    // read only copy of the walkable data, kept alive until we are done
+    std::shared_ptr<const OccupancyGrid> grid;
+    // grid->version, used to tell if the result is still good to cache
+    int version = 0;
+
+    // only safe to read once done is true, nullptr if it was cancelled.
+    // Might be shared with the PathCache so follow it with a PathCursor
+    // going to end rather than reading the last point
+    SharedPath path;
+    std::atomic<bool> done{false};
+    // set by the owner if it no longer wants the result
+    std::atomic<bool> cancelled{false};
+};
+
+// Whoever submitted the request polls ticket->done each frame
+typedef std::shared_ptr<PathRequest> PathTicket;
+
+// Runs path searches on a fixed pool of worker threads so a wave of agents
+// starting jobs on the same frame doesnt stall it.
+//
+// Workers never touch live game state, each request carries a snapshot of
+// the occupancy grid which is only recopied when the layout changes
+struct PathService {
+    // false runs every request inline on submit (useful for benchmarks and
+    // anything that needs to be deterministic)
+    bool useWorkers = true;
+    // workers still search but update() waits for them, so results land on
+    // the same tick every run no matter how the threads get scheduled
+    bool lockstep = false;
+    int numWorkers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex queueMutex;
+    std::condition_variable queueCV;
+    std::condition_variable idleCV;
+    // tasks a worker has taken off the queue but not finished
+    int running = 0;
+    bool stopping = false;
+
+    std::shared_ptr<const OccupancyGrid> snapshot;
+
+    PathCache cache;
+    // submitted to the workers, waiting to be put in the cache
+    std::vector<PathTicket> inFlight;
+
+    // time spent searching, on whatever thread did it
+    std::atomic<int64_t> searchNanos{0};
+    std::atomic<int> numSearches{0};
+
+    inline static PathService& get() {
+        static PathService service;
+        return service;
+    }
+
+    ~PathService() { stop(); }
+
+    PathTicket submit(const glm::vec2& start, const glm::vec2& end,
+                      const glm::vec2& size) {
+        auto req = std::make_shared<PathRequest>();
+        req->start = start;
+        req->end = end;
+        req->size = size;
+
+        if (auto cached = cache.get(start, end, size)) {
+            // might be for a nearby end, PathCursor takes care of that
+            if (endsWalkable(*cached, start, end, size)) {
+                req->path = cached;
+                req->done = true;
+                return req;
+            }
+            cache.countAsMiss();
+        }
+
+        req->grid = snapshotFor(size);
+        req->version = req->grid->version;
+
+        if (!useWorkers) {
+            solve(*req);
+            cache.put(start, end, size, req->path);
+            return req;
+        }
+        inFlight.push_back(req);
+        run([req]() { solve(*req); });
+        return req;
+    }
+
+    // Runs task on a worker (or right now if useWorkers is off), anything
+    // it reads has to be a snapshot, not live game state
+    void run(const std::function<void()>& task) {
+        if (!useWorkers) {
+            task();
+            return;
+        }
+        if (workers.empty()) startWorkers();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(task);
+        }
+        queueCV.notify_one();
+    }
+
+    // Moves finished worker results into the cache,
+    // call once a frame from the main thread
+    void update() {
+        if (lockstep) waitIdle();
+        int liveVersion = Occupancy::grid().version;
+        auto it = inFlight.begin();
+        while (it != inFlight.end()) {
+            PathRequest& req = **it;
+            if (!req.done.load(std::memory_order_acquire)) {
+                it++;
+                continue;
+            }
+            // if the layout changed while we were searching the path
+            // might already be stale
+            if (!req.cancelled && req.version == liveVersion) {
+                cache.put(req.start, req.end, req.size, req.path);
+            }
+            it = inFlight.erase(it);
+        }
+    }
+
+    // A cached path was searched from a start and to an end up to
+    // PathCache::QUANTUM away from ours, so walking from start to its first
+    // point and from its second to last point to end (see PathCursor) was
+    // never checked
+    static bool endsWalkable(const OccupancyGrid& grid,
+                             const OccupancyGrid::Layer& layer,
+                             const std::vector<glm::vec2>& points,
+                             const glm::vec2& start, const glm::vec2& end) {
+        if (points.empty()) return false;
+        glm::vec2 beforeEnd =
+            points.size() >= 2 ? points[points.size() - 2] : start;
+        return PathHierarchy::lineOfSight(grid, layer, start, points.front()) &&
+               PathHierarchy::lineOfSight(grid, layer, beforeEnd, end);
+    }
+
+    // Against the live grid, has to run on the main thread
+    static bool endsWalkable(const std::vector<glm::vec2>& points,
+                             const glm::vec2& start, const glm::vec2& end,
+                             const glm::vec2& size) {
+        const OccupancyGrid& live = Occupancy::grid();
+        if (live.empty()) return true;
+        const OccupancyGrid::Layer* layer = live.findLayer(size);
+        // nobody this size has searched yet so this cant be from the grid
+        // we have now
+        if (!layer) return false;
+        return endsWalkable(live, *layer, points, start, end);
+    }
+
+    // Registered with SpatialIndex::addLayoutListener
+    static void onLayoutChanged(const std::shared_ptr<Entity>& e, bool) {
+        glm::vec2 lo = glm::min(e->position, e->position + e->size);
+        glm::vec2 hi = glm::max(e->position, e->position + e->size);
+        get().cache.invalidate(glm::vec4{lo.x, lo.y, hi.x, hi.y});
+    }
+
+    // Blocks until the workers have nothing left to do
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        idleCV.wait(lock, [&]() { return queue.empty() && running == 0; });
+    }
+
+    int numPending() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return (int)queue.size();
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCV.notify_all();
+        for (auto& t : workers) t.join();
+        workers.clear();
+        stopping = false;
+    }
+
+    static void solve(PathRequest& req) {
+        if (!req.cancelled) {
+            auto start = std::chrono::high_resolution_clock::now();
+            const OccupancyGrid::Layer* layer = req.grid->findLayer(req.size);
+            req.path = makeSharedPath(findPath(Walkable{req.grid.get(), layer},
+                                               req.start, req.end));
+            auto took = std::chrono::high_resolution_clock::now() - start;
+            get().searchNanos +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(took)
+                    .count();
+            get().numSearches++;
+        }
+        req.grid.reset();
+        req.done.store(true, std::memory_order_release);
+    }
+
+    // Has to run on the main thread since it reads the live grid
+    std::shared_ptr<const OccupancyGrid> snapshotFor(const glm::vec2& size) {
+        OccupancyGrid& live = Occupancy::grid();
+        // make sure the copy has a layer for this agent size
+        live.layerFor(size);
+        // only rebuilds the clusters that changed
+        PathHierarchy::refresh(live);
+        if (!snapshot || snapshot->version != live.version) {
+            snapshot = std::make_shared<const OccupancyGrid>(live);
+        }
+        return snapshot;
+    }
+
+    void startWorkers() {
+        for (int i = 0; i < numWorkers; i++) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCV.wait(lock,
+                             [&]() { return stopping || !queue.empty(); });
+                if (stopping) return;
+                task = queue.front();
+                queue.pop_front();
+                running++;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                running--;
+            }
+            idleCV.notify_all();
+        }
+    }
+};
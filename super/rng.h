@@ -0,0 +1,86 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Seeded random numbers for the simulation so two runs with the same seed
+// do the same work (see scenario.h).
+//
+// Rng is counter based (splitmix64 of key + counter), so a stream is just a
+// key and how far along it is. Every entity gets its own stream from
+// RngService::forEntity, which means it gets the same numbers no matter
+// which thread runs its update or what order everyone else went in.
+struct Rng {
+    uint64_t key = 0;
+    uint64_t counter = 0;
+
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t next() { return mix(key + (++counter) * 0x9e3779b97f4a7c15ull); }
+
+    // new independent stream, same stream id gives the same stream
+    Rng split(uint64_t stream) const {
+        return Rng{mix(key ^ mix(stream + 0x632be59bd9b4e019ull)), 0};
+    }
+
+    // [a, b] like randIn, an empty range (b < a, say picking from an empty
+    // catalog) just gives back a instead of dividing by zero. Always draws
+    // one number so the rest of the stream doesnt depend on the bounds
+    int range(int a, int b) {
+        uint64_t r = next();
+        if (b <= a) return a;
+        return a + (int)(r % (uint64_t)((int64_t)b - a + 1));
+    }
+
+    // [0, 1)
+    float uniform() { return (float)(next() >> 40) / (float)(1ull << 24); }
+    float uniform(float a, float b) { return a + (b - a) * uniform(); }
+
+    // point on a circle, like glm::circularRand
+    glm::vec2 circular(float radius) {
+        float a = uniform(0.f, 6.28318531f);
+        return glm::vec2{cos(a), sin(a)} * radius;
+    }
+
+    // like gen_rand_vec4
+    glm::vec4 vec4(float a, float b) {
+        float x = uniform(a, b);
+        float y = uniform(a, b);
+        float z = uniform(a, b);
+        return glm::vec4{x, y, z, uniform(a, b)};
+    }
+
+    template <typename T>
+    T& pick(std::vector<T>& from) {
+        return from[range(0, (int)from.size() - 1)];
+    }
+};
+
+struct RngService {
+    uint64_t seed = 0;
+    // for anything that runs on the main thread between updates (filling
+    // the job queue etc)
+    Rng main;
+
+    RngService() { reseed(0); }
+
+    inline static RngService& get() {
+        static RngService service;
+        return service;
+    }
+
+    // call before building the store, entities made before this keep the
+    // stream they already had
+    void reseed(uint64_t s) {
+        seed = s;
+        main = Rng{Rng::mix(s), 0}.split(0);
+    }
+
+    Rng forEntity(int id) const {
+        return Rng{Rng::mix(seed), 0}.split((uint64_t)id + 1);
+    }
+};
@@ -0,0 +1,168 @@
+
+#pragma once
+
+#include <sys/resource.h>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "simulation.h"
+
+// Scenario benchmarks: generated stores at a range of sizes, run headless
+// for a few simulated minutes, reported as json so runs from two versions
+// can be diffed. See `make super_scenarios`.
+
+#ifndef SUPER_VERSION
+#define SUPER_VERSION "unknown"
+#endif
+
+// bumped by the operator new in sim_main.cpp, stays at zero anywhere else
+static std::atomic<uint64_t> allocCount_DO_NOT_USE{0};
+static std::atomic<uint64_t> allocBytes_DO_NOT_USE{0};
+
+struct Allocations {
+    static void note(size_t size) {
+        allocCount_DO_NOT_USE.fetch_add(1, std::memory_order_relaxed);
+        allocBytes_DO_NOT_USE.fetch_add(size, std::memory_order_relaxed);
+    }
+    static uint64_t count() { return allocCount_DO_NOT_USE.load(); }
+    static uint64_t bytes() { return allocBytes_DO_NOT_USE.load(); }
+};
+
+struct Scenario {
+    const char* name;
+    int customers;
+    int employees;
+    int shelves;
+    int items;
+    unsigned int seed = 1;
+};
+
+// clang-format off
+static const std::array<Scenario, 4> SCENARIOS = {{
+    //  name       customers  employees  shelves  items
+    {"tiny",            10,        2,       100,     4},
+    {"small",          100,       10,      1000,   100},
+    {"medium",        1000,       50,     10000,  1000},
+    {"large",        10000,      200,     50000, 10000},
+}};
+// clang-format on
+
+// largest resident set this process has had so far
+inline long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // bytes on mac
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// Rows of shelves two apart so there is an aisle between every row, with a
+// cross aisle every ten shelves and the storage boxes along the front
+inline void build_scenario_store(Simulation& sim, const Scenario& s) {
+    RngService::get().reseed(s.seed);
+    Rng& rng = RngService::get().main;
+    sim.registerListeners();
+    ItemManager::get().generate(s.items);
+
+    int rowLength = std::max(10, (int)ceil(sqrt((float)s.shelves)));
+    int placed = 0;
+    for (int row = 0; placed < s.shelves; row++) {
+        for (int x = 0; x < rowLength && placed < s.shelves; x++) {
+            if (x % 10 == 9) continue;
+            auto shelf = std::make_shared<Shelf>(
+                glm::vec2{(float)x, 2.f * row}, glm::vec2{1.f, 1.f}, 0.f,
+                glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}, "shelf");
+            shelf->contents.addItem(placed % s.items, 10);
+            SpatialIndex::addEntity(shelf);
+            placed++;
+        }
+    }
+
+    int numStorage = std::max(1, s.shelves / 100);
+    for (int i = 0; i < numStorage; i++) {
+        // more rows of boxes going away from the shelves if we run out
+        int x = (2 * i) % rowLength;
+        int row = (2 * i) / rowLength;
+        auto storage = std::make_shared<Storage>(
+            glm::vec2{(float)x, -3.f - 2.f * row}, glm::vec2{1.f, 1.f}, 0.f,
+            glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}, "box");
+        for (int j = 0; j < 8; j++) {
+            storage->contents.addItem((i * 8 + j) % s.items, 20);
+        }
+        SpatialIndex::addEntity(storage);
+    }
+
+    for (int i = 0; i < s.employees; i++) {
+        auto emp = Employee();
+        emp.position = {rng.range(0, rowLength - 1), -2.f};
+        emp.size = {0.6f, 0.6f};
+        emp.textureName = "player";
+        SpatialIndex::addEntity(std::make_shared<Employee>(emp));
+    }
+
+    for (int i = 0; i < s.customers; i++) {
+        auto cust = Customer();
+        cust.position = {rng.range(0, rowLength - 1), -6.f};
+        cust.size = {0.6f, 0.6f};
+        cust.textureName = "player2";
+        SpatialIndex::addEntity(std::make_shared<Customer>(cust));
+    }
+}
+
+// Builds and runs one scenario in this process and returns its json. Only
+// makes sense once per process, everything is still global so the next one
+// would start in the last ones store (sim_main.cpp forks for each)
+inline std::string run_scenario(const Scenario& s, float minutes) {
+    const float dt = 1.f / 60.f;
+    using clock = std::chrono::high_resolution_clock;
+    auto seconds = [](clock::time_point from) {
+        return std::chrono::duration<double>(clock::now() - from).count();
+    };
+
+    Simulation sim;
+    // same seed, same work
+    PathService::get().lockstep = true;
+    auto start = clock::now();
+    build_scenario_store(sim, s);
+    double setupTook = seconds(start);
+
+    uint64_t allocs = Allocations::count();
+    uint64_t allocBytes = Allocations::bytes();
+    // customers already asked for paths during setup
+    int64_t searchNanos = PathService::get().searchNanos.load();
+    int searches = PathService::get().numSearches.load();
+    int steps = (int)std::lround(minutes * 60.f * 60.f);
+    start = clock::now();
+    for (int i = 0; i < steps; i++) sim.step(Time(dt));
+    double took = seconds(start);
+    allocs = Allocations::count() - allocs;
+    allocBytes = Allocations::bytes() - allocBytes;
+    searchNanos = PathService::get().searchNanos.load() - searchNanos;
+    searches = PathService::get().numSearches.load() - searches;
+
+    const SimTimings& t = sim.timings;
+    std::string out = fmt::format(
+        "{{\"name\": \"{}\", \"customers\": {}, \"employees\": {}, "
+        "\"shelves\": {}, \"items\": {}, \"seed\": {}, "
+        "\"simulated_seconds\": {:.1f}, \"ticks\": {}, "
+        "\"setup_ms\": {:.2f}, \"wall_ms\": {:.2f}, "
+        "\"ms_per_tick\": {:.4f}, ",
+        s.name, s.customers, s.employees, s.shelves, s.items, s.seed,
+        steps * dt, steps, setupTook * 1000.0, took * 1000.0,
+        took * 1000.0 / std::max(steps, 1));
+    out += fmt::format(
+        "\"subsystems_ms\": {{\"entity_update\": {:.2f}, \"spatial\": {:.2f}, "
+        "\"job_scheduling\": {:.2f}, \"pathing\": {:.2f}, "
+        "\"cleanup\": {:.2f}, \"path_search_cpu\": {:.2f}}}, ",
+        t.entityUpdate, t.spatial, t.jobs, t.pathing, t.cleanup,
+        searchNanos / 1e6);
+    out += fmt::format(
+        "\"allocations\": {}, \"allocated_bytes\": {}, \"peak_rss_kb\": {}, "
+        "\"entities\": {}, \"jobs_assigned\": {}, \"path_searches\": {}}}",
+        allocs, allocBytes, peak_rss_kb(), sim.updateOrder.size(),
+        JobAssigner::get().jobsAssigned, searches);
+
+    PathService::get().stop();
+    return out;
+}
@@ -0,0 +1,152 @@
+
+
+#define BACKWARD_SUPERMARKET
+#include "../vendor/backward.hpp"
+//
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "custom_fmt.h"
+#include "scenario.h"
+#include "simulation.h"
+//
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Headless store, no window and no GL context. Runs the simulation at a
+// fixed timestep as fast as it can and reports how many simulated seconds it
+// gets through per wall clock second.
+//
+// super_sim.exe [simulated seconds] [employees] [customers] [seed]
+//
+// make super_sim SIM_ARGS="3600 20 50" for an hour long soak test
+//
+// super_sim.exe scenarios [out.json] [simulated minutes] [names...]
+//
+// runs the stores in SCENARIOS (scenario.h, all but "large" by default) and
+// writes the results as json, see make super_scenarios
+
+// counted so the scenarios can report allocations. noinline or gcc sees
+// new and delete inlined next to each other and warns about malloc vs free
+[[gnu::noinline]] void* operator new(size_t size) {
+    Allocations::note(size);
+    void* p = malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept { free(p); }
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// Each scenario gets its own process so it starts from an empty store and
+// peak rss is just its own
+std::string fork_scenario(const Scenario& s, float minutes) {
+    int fds[2];
+    if (pipe(fds) != 0) return "";
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        std::string json = run_scenario(s, minutes);
+        size_t written = 0;
+        while (written < json.size()) {
+            ssize_t n =
+                write(fds[1], json.data() + written, json.size() - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        close(fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string json;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) json.append(buf, n);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || json.empty()) {
+        return fmt::format(
+            "{{\"name\": \"{}\", \"error\": \"exited with {}\"}}", s.name,
+            status);
+    }
+    return json;
+}
+
+int run_scenarios(int argc, char** argv) {
+    std::string outFile = argc > 2 ? argv[2] : "scenarios.json";
+    float minutes = argc > 3 ? (float)atof(argv[3]) : 1.f;
+    std::vector<std::string> names;
+    for (int i = 4; i < argc; i++) names.push_back(argv[i]);
+
+    std::vector<std::string> results;
+    for (const Scenario& s : SCENARIOS) {
+        bool wanted = names.empty()
+                          ? strcmp(s.name, "large") != 0
+                          : std::find(names.begin(), names.end(), s.name) !=
+                                names.end();
+        if (!wanted) continue;
+        log_info("running {} for {} simulated minutes", s.name, minutes);
+        results.push_back(fork_scenario(s, minutes));
+        log_info("{}", results.back());
+    }
+
+    std::ofstream out(outFile);
+    out << fmt::format(
+        "{{\"version\": \"{}\", \"minutes\": {}, \"scenarios\": [\n",
+        SUPER_VERSION, minutes);
+    for (size_t i = 0; i < results.size(); i++) {
+        out << "  " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    log_info("wrote {}", outFile);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    backward::SignalHandling sh;
+
+    if (argc > 1 && strcmp(argv[1], "scenarios") == 0) {
+        return run_scenarios(argc, argv);
+    }
+
+    float seconds = argc > 1 ? (float)atof(argv[1]) : 600.f;
+    int numEmployees = argc > 2 ? atoi(argv[2]) : 1;
+    int numCustomers = argc > 3 ? atoi(argv[3]) : 1;
+    uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 0;
+    // same as the game at 60fps
+    const float dt = 1.f / 60.f;
+    // once a simulated minute
+    const int reportEvery = 60 * 60;
+
+    Simulation sim;
+    // so the same seed replays the same run
+    PathService::get().lockstep = true;
+    sim.setup(numEmployees, numCustomers, seed);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto wall = [&]() {
+        auto now = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double>(now - start).count();
+    };
+
+    int steps = (int)(seconds / dt);
+    for (int i = 1; i <= steps; i++) {
+        sim.step(Time(dt));
+        if (i % reportEvery != 0) continue;
+        int queued = 0;
+        for (int t = 0; t < JobType::MAX_JOB_TYPE; t++) {
+            queued += JobQueue::numOfJobsWithType((JobType)t);
+        }
+        log_info("{:.0f}s simulated in {:.1f}s: {} entities, {} jobs queued, "
+                 "{} handed out so far",
+                 i * dt, wall(), sim.updateOrder.size(), queued,
+                 JobAssigner::get().jobsAssigned);
+    }
+
+    double took = wall();
+    log_info("simulated {:.0f}s in {:.2f}s, {:.1f} simulated seconds per second",
+             steps * dt, took, steps * dt / std::max(took, 1e-9));
+
+    PathService::get().stop();
+    return 0;
+}
@@ -0,0 +1,187 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "customer.h"
+#include "employee.h"
+#include "entities.h"
+#include "entity_update.h"
+#include "flow_field.h"
+#include "job.h"
+#include "movement.h"
+#include "occupancy_grid.h"
+#include "path_service.h"
+#include "rng.h"
+#include "spatial_index.h"
+
+// Main thread time spent in each part of the simulation (ms), path
+// searches on the PathService workers are counted by the PathService
+struct SimTimings {
+    double entityUpdate = 0.0;
+    double spatial = 0.0;
+    double jobs = 0.0;
+    double pathing = 0.0;
+    double cleanup = 0.0;
+};
+
+// Everything about running the store that doesnt need a window. SuperLayer
+// drives it from the game loop and super_sim (sim_main.cpp) runs it
+// headless as fast as it can
+struct Simulation {
+    // copy of the entity list for EntityUpdater, kept to reuse its memory
+    std::vector<std::shared_ptr<Entity>> updateOrder;
+    // fillJobQueue picks from these, refilled each time it needs one
+    std::vector<std::shared_ptr<Shelf>> shelves;
+    SimTimings timings;
+
+    template <typename Fn>
+    static void timed(double& total, Fn fn) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        auto end = std::chrono::high_resolution_clock::now();
+        total += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // has to happen before we place any furniture
+    void registerListeners() {
+        SpatialIndex::addLayoutListener(Occupancy::onLayoutChanged);
+        SpatialIndex::addLayoutListener(PathService::onLayoutChanged);
+        SpatialIndex::addLayoutListener(FlowFieldCache::onLayoutChanged);
+        SpatialIndex::addLayoutListener(StockIndex::onLayoutChanged);
+    }
+
+    // The store you get when starting a game
+    void setup(int numEmployees = 1, int numCustomers = 1,
+               uint64_t seed = 0) {
+        RngService::get().reseed(seed);
+        registerListeners();
+
+        for (int i = 0; i < 5; i++) {
+            for (int j = 0; j < 10; j += 2) {
+                if (i == 0 && j == 4) {
+                    continue;
+                }
+                auto shelf2 = std::make_shared<Shelf>(
+                    glm::vec2{1.f + i, -3.f + j},  //
+                    glm::vec2{1.f, 1.f}, 0.f,      //
+                    glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}, "shelf");
+                SpatialIndex::addEntity(shelf2);
+            }
+        }
+
+        auto storage = std::make_shared<Storage>(
+            glm::vec2{1.f, 1.f}, glm::vec2{1.f, 1.f}, 0.f,
+            glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}, "box");
+        storage->contents.addItem(0, 1);
+        storage->contents.addItem(1, 6);
+        storage->contents.addItem(2, 7);
+        storage->contents.addItem(3, 9);
+        SpatialIndex::addEntity(storage);
+
+        const int num_people_sprites = 3;
+        std::array<std::string, num_people_sprites> peopleSprites = {
+            "player",
+            "player2",
+            "player3",
+        };
+
+        for (int i = 0; i < numEmployees; i++) {
+            auto emp = Employee();
+            emp.color = emp.rng.vec4(0.3f, 1.0f);
+            emp.color.w = 1.f;
+            emp.size = {0.6f, 0.6f};
+            emp.textureName = peopleSprites[0];
+            SpatialIndex::addEntity(std::make_shared<Employee>(emp));
+        }
+
+        for (int i = 0; i < numCustomers; i++) {
+            auto cust = Customer();
+            cust.color = cust.rng.vec4(0.3f, 1.0f);
+            cust.color.w = 1.f;
+            cust.size = {0.6f, 0.6f};
+            cust.textureName =
+                peopleSprites[(i % (num_people_sprites - 1)) + 1];
+            SpatialIndex::addEntity(std::make_shared<Customer>(cust));
+        }
+    }
+
+    // Move things around
+    void update(Time dt) {
+        // everyone thinks in parallel, then we apply what they decided
+        timed(timings.entityUpdate, [&]() {
+            updateOrder.clear();
+            EntityHelper::forEachEntity([&](auto entity) {  //
+                updateOrder.push_back(entity);
+                return EntityHelper::ForEachFlow::None;
+            });
+            EntityUpdater::get().update(updateOrder, dt);
+            // everyone who asked to move takes their step
+            MovementStore::get().integrate(dt.s());
+        });
+        // rebucket anything that moved
+        timed(timings.spatial, []() { SpatialIndex::update(); });
+        // hand out jobs to anyone idle, also flushes the JobQueue
+        timed(timings.jobs, []() { JobAssigner::get().assign(); });
+        timed(timings.pathing, []() {
+            PathService::get().update();  // cache any paths that finished
+            FlowFieldCache::get().update();
+        });
+    }
+
+    // Call after update (and rendering, if there is any)
+    void endOfFrame() {
+        // add more jobs if needed
+        timed(timings.jobs, [&]() { fillJobQueue(); });
+        timed(timings.cleanup, []() {
+            SpatialIndex::cleanup();  // Drop dead entities from the index
+            EntityHelper::cleanup();  // Cleanup dead entities
+        });
+    }
+
+    void step(Time dt) {
+        update(dt);
+        endOfFrame();
+    }
+
+    void fillJobQueue() {
+        Rng& rng = RngService::get().main;
+        if (JobQueue::numOfJobsWithType(JobType::IdleWalk) < 5) {
+            JobQueue::addJob(JobType::IdleWalk,
+                             Job({.type = JobType::IdleWalk,
+                                  .endPosition = rng.circular(5.f)}));
+        }
+
+        if (JobQueue::numOfJobsWithType(JobType::IdleShop) < 5) {
+            JobQueue::addJob(JobType::IdleShop,
+                             Job({.type = JobType::IdleShop,
+                                  .endPosition = rng.circular(5.f)}));
+        }
+
+        shelves.clear();
+        EntityHelper::forEach<Storage>([&](auto storage) {
+            // TODO for now just keep queue jobs until we are empty
+            if (!storage->contents.empty() &&
+                JobQueue::numOfJobsWithType(JobType::Fill) <
+                    (int)storage->contents.size()) {
+                // TODO getting random shelf probably not the best
+                // idea.. .
+                if (shelves.empty()) {
+                    EntityHelper::forEach<Shelf>([&](auto shelf) {
+                        shelves.push_back(shelf);
+                        return EntityHelper::ForEachFlow::None;
+                    });
+                }
+                if (shelves.empty()) return EntityHelper::ForEachFlow::Break;
+                Job j = {
+                    .type = JobType::Fill,
+                    .startPosition = storage->position,
+                    .endPosition = rng.pick(shelves)->position,
+                    .itemID = storage->contents.rbegin()->first,
+                    .itemAmount = storage->contents.rbegin()->second,
+                };
+                JobQueue::addJob(JobType::Fill, j);
+            }
+            return EntityHelper::ForEachFlow::None;
+        });
+    }
+};
@@ -0,0 +1,100 @@
+
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Vector that keeps the first N elements inside itself and only goes to the
+// heap once it grows past that. Only for trivially copyable T, elements are
+// moved around with memcpy / memmove
+template <typename T, int N>
+struct SmallVector {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "SmallVector moves elements with memcpy");
+
+    T local[N];
+    T* items = local;
+    int count = 0;
+    int capacity = N;
+
+    SmallVector() {}
+    SmallVector(const SmallVector& other) { *this = other; }
+    SmallVector(SmallVector&& other) { *this = std::move(other); }
+    ~SmallVector() { release(); }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this == &other) return *this;
+        count = 0;
+        reserve(other.count);
+        if (other.count) memcpy(items, other.items, other.count * sizeof(T));
+        count = other.count;
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) {
+        if (this == &other) return *this;
+        if (other.items == other.local) {
+            *this = (const SmallVector&)other;
+        } else {
+            // just take their heap block
+            release();
+            items = other.items;
+            capacity = other.capacity;
+            count = other.count;
+            other.items = other.local;
+            other.capacity = N;
+        }
+        other.count = 0;
+        return *this;
+    }
+
+    void release() {
+        if (items != local) free(items);
+        items = local;
+        capacity = N;
+    }
+
+    void reserve(int n) {
+        if (n <= capacity) return;
+        int cap = std::max(n, capacity * 2);
+        T* bigger = (T*)malloc(cap * sizeof(T));
+        if (count) memcpy(bigger, items, count * sizeof(T));
+        if (items != local) free(items);
+        items = bigger;
+        capacity = cap;
+    }
+
+    T* insert(T* at, const T& value) {
+        int i = (int)(at - items);
+        reserve(count + 1);
+        memmove(items + i + 1, items + i, (count - i) * sizeof(T));
+        items[i] = value;
+        count++;
+        return items + i;
+    }
+
+    void push_back(const T& value) {
+        reserve(count + 1);
+        items[count++] = value;
+    }
+
+    void erase(T* at) {
+        int i = (int)(at - items);
+        memmove(items + i, items + i + 1, (count - i - 1) * sizeof(T));
+        count--;
+    }
+
+    void clear() { count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool onHeap() const { return items != local; }
+
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+    T& operator[](int i) { return items[i]; }
+    const T& operator[](int i) const { return items[i]; }
+};
@@ -0,0 +1,347 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/entity.h"
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "item.h"
+
+// Inclusive range of grid cells an entity's bounding box touches
+struct CellRect {
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+
+    bool operator==(const CellRect& o) const {
+        return minX == o.minX && minY == o.minY && maxX == o.maxX &&
+               maxY == o.maxY;
+    }
+    bool operator!=(const CellRect& o) const { return !(*this == o); }
+};
+
+// Uniform grid of buckets so that range / selection queries only look at the
+// entities near the query instead of walking every entity in the world.
+//
+// Entities are stored in every cell their bounding box overlaps
+// (position -> position + size, same box pointCollides uses)
+struct SpatialHash {
+    struct Entry {
+        std::shared_ptr<Entity> entity;
+        CellRect cells;
+    };
+
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<Entry>> cells;
+    // entity id -> the cells it was last inserted into
+    std::unordered_map<int, CellRect> entityCells;
+    // every cell that has ever held something, used to bound open searches
+    CellRect bounds = {0, 0, -1, -1};
+
+    explicit SpatialHash(float cs = 2.f) : cellSize(cs) {}
+
+    static uint64_t key(int x, int y) {
+        return ((uint64_t)(uint32_t)x << 32) | (uint64_t)(uint32_t)y;
+    }
+
+    int toCell(float v) const { return (int)std::floor(v / cellSize); }
+
+    CellRect cellsFor(const glm::vec2& pos, const glm::vec2& sz) const {
+        // size can be negative (see DragArea) so normalize first
+        glm::vec2 lo = glm::min(pos, pos + sz);
+        glm::vec2 hi = glm::max(pos, pos + sz);
+        return {toCell(lo.x), toCell(lo.y), toCell(hi.x), toCell(hi.y)};
+    }
+
+    // rect is (minx, miny, maxx, maxy) like getEntityInSelection
+    CellRect cellsFor(const glm::vec4& rect) const {
+        return {toCell(rect.x), toCell(rect.y), toCell(rect.z),
+                toCell(rect.w)};
+    }
+
+    bool empty() const { return entityCells.empty(); }
+    size_t size() const { return entityCells.size(); }
+
+    void clear() {
+        cells.clear();
+        entityCells.clear();
+        bounds = {0, 0, -1, -1};
+    }
+
+    void insert(const std::shared_ptr<Entity>& e) {
+        if (entityCells.find(e->id) != entityCells.end()) remove(e->id);
+
+        CellRect r = cellsFor(e->position, e->size);
+        for (int x = r.minX; x <= r.maxX; x++) {
+            for (int y = r.minY; y <= r.maxY; y++) {
+                cells[key(x, y)].push_back(Entry{e, r});
+            }
+        }
+        entityCells[e->id] = r;
+
+        if (bounds.maxX < bounds.minX) {
+            bounds = r;
+        } else {
+            bounds = {std::min(bounds.minX, r.minX),
+                      std::min(bounds.minY, r.minY),
+                      std::max(bounds.maxX, r.maxX),
+                      std::max(bounds.maxY, r.maxY)};
+        }
+    }
+
+    void remove(int id) {
+        auto it = entityCells.find(id);
+        if (it == entityCells.end()) return;
+        CellRect r = it->second;
+        for (int x = r.minX; x <= r.maxX; x++) {
+            for (int y = r.minY; y <= r.maxY; y++) {
+                auto bucket = cells.find(key(x, y));
+                if (bucket == cells.end()) continue;
+                auto& entries = bucket->second;
+                for (size_t i = 0; i < entries.size(); i++) {
+                    if (entries[i].entity->id != id) continue;
+                    // order inside a bucket doesnt matter
+                    entries[i] = entries.back();
+                    entries.pop_back();
+                    break;
+                }
+                if (entries.empty()) cells.erase(bucket);
+            }
+        }
+        entityCells.erase(it);
+    }
+
+    // Re-buckets the entity if it moved into different cells,
+    // returns true if anything changed
+    bool update(const std::shared_ptr<Entity>& e) {
+        auto it = entityCells.find(e->id);
+        if (it == entityCells.end()) {
+            insert(e);
+            return true;
+        }
+        if (cellsFor(e->position, e->size) == it->second) return false;
+        insert(e);
+        return true;
+    }
+
+    // Calls cb once for every entity that lives in a cell touched by rect.
+    // This is a broadphase, cb still has to do the exact check
+    template <typename Fn>
+    void forEachInRect(const glm::vec4& rect, Fn cb) const {
+        CellRect q = cellsFor(rect);
+        // dont walk cells that can never have anything in them
+        q = {std::max(q.minX, bounds.minX), std::max(q.minY, bounds.minY),
+             std::min(q.maxX, bounds.maxX), std::min(q.maxY, bounds.maxY)};
+
+        for (int x = q.minX; x <= q.maxX; x++) {
+            for (int y = q.minY; y <= q.maxY; y++) {
+                auto bucket = cells.find(key(x, y));
+                if (bucket == cells.end()) continue;
+                for (const Entry& entry : bucket->second) {
+                    // entities spanning multiple cells are in each of them,
+                    // only report them from the first cell both rects share
+                    if (x != std::max(entry.cells.minX, q.minX) ||
+                        y != std::max(entry.cells.minY, q.minY))
+                        continue;
+                    if (cb(entry.entity) == EntityHelper::ForEachFlow::Break)
+                        return;
+                }
+            }
+        }
+    }
+};
+
+// Called when something that doesnt move (shelves, storage) is added
+// (added = true) or removed so anything caching the store layout can update
+// just the area that changed
+typedef std::function<void(const std::shared_ptr<Entity>&, bool added)>
+    LayoutListener;
+
+static SpatialHash spatialHash_DO_NOT_USE;
+static std::vector<std::shared_ptr<Entity>> spatialMovers_DO_NOT_USE;
+static std::vector<LayoutListener> layoutListeners_DO_NOT_USE;
+
+// Mirrors the EntityHelper queries but answers them from the spatial hash.
+//
+// Anything added through here is also added to EntityHelper so
+// forEachEntity / render still see it
+struct SpatialIndex {
+    static SpatialHash& grid() { return spatialHash_DO_NOT_USE; }
+
+    static void addLayoutListener(const LayoutListener& fn) {
+        layoutListeners_DO_NOT_USE.push_back(fn);
+    }
+
+    static void addEntity(const std::shared_ptr<Entity>& e) {
+        EntityHelper::addEntity(e);
+        grid().insert(e);
+        if (e->canMove()) {
+            spatialMovers_DO_NOT_USE.push_back(e);
+            return;
+        }
+        for (auto& fn : layoutListeners_DO_NOT_USE) fn(e, true);
+    }
+
+    // Call once per frame after entities have moved
+    static void update() {
+        for (auto& e : spatialMovers_DO_NOT_USE) {
+            grid().update(e);
+        }
+    }
+
+    // Call before EntityHelper::cleanup so we drop the same entities
+    static void cleanup() {
+        EntityHelper::forEachEntity([](auto e) {
+            if (!e->cleanup) return EntityHelper::ForEachFlow::Continue;
+            grid().remove(e->id);
+            if (!e->canMove()) {
+                for (auto& fn : layoutListeners_DO_NOT_USE) fn(e, false);
+            }
+            return EntityHelper::ForEachFlow::None;
+        });
+        auto& movers = spatialMovers_DO_NOT_USE;
+        movers.erase(std::remove_if(movers.begin(), movers.end(),
+                                    [](const auto& e) { return e->cleanup; }),
+                     movers.end());
+    }
+
+    template <typename T>
+    static void sortByDistance(const glm::vec2& pos,
+                               std::vector<std::shared_ptr<T>>& matching) {
+        std::sort(matching.begin(), matching.end(),
+                  [&](const auto& a, const auto& b) {
+                      return glm::distance(pos, a->position) <
+                             glm::distance(pos, b->position);
+                  });
+    }
+
+    // Nearest first
+    template <typename T>
+    static std::vector<std::shared_ptr<T>> getEntitiesInRange(glm::vec2 pos,
+                                                              float range) {
+        std::vector<std::shared_ptr<T>> matching;
+        grid().forEachInRect(
+            glm::vec4{pos.x - range, pos.y - range, pos.x + range,
+                      pos.y + range},
+            [&](const std::shared_ptr<Entity>& e) {
+                auto s = dynamic_pointer_cast<T>(e);
+                if (s && glm::distance(pos, s->position) < range) {
+                    matching.push_back(s);
+                }
+                return EntityHelper::ForEachFlow::None;
+            });
+        sortByDistance(pos, matching);
+        return matching;
+    }
+
+    // Nearest first, range < 0 means anywhere in the store.
+    //
+    // Most items are only on a handful of shelves so we just check the ones
+    // the StockIndex says have it, anything stocked all over the place goes
+    // through searchWithItem instead
+    template <typename T>
+    static std::vector<std::shared_ptr<T>> getEntityInRangeWithItem(
+        glm::vec2 pos, int itemID, float range) {
+        const auto& stocking = StockIndex::get().stocking(itemID);
+        if ((int)stocking.size() > StockIndex::SCAN_LIMIT) {
+            return searchWithItem<T>(pos, itemID, range);
+        }
+        std::vector<std::shared_ptr<T>> matching;
+        for (const auto& e : stocking) {
+            auto s = dynamic_pointer_cast<T>(e);
+            if (!s || s->contents.find(itemID) == s->contents.end()) continue;
+            if (range >= 0 && glm::distance(pos, s->position) >= range)
+                continue;
+            matching.push_back(s);
+        }
+        sortByDistance(pos, matching);
+        return matching;
+    }
+
+    // Same answer from the grid alone, checking the contents of everything
+    // nearby. With range < 0 instead of returning every match we grow the
+    // search until we find the closest ones
+    template <typename T>
+    static std::vector<std::shared_ptr<T>> searchWithItem(glm::vec2 pos,
+                                                          int itemID,
+                                                          float range) {
+        std::vector<std::shared_ptr<T>> matching;
+        auto collect = [&](float r) {
+            matching.clear();
+            grid().forEachInRect(
+                glm::vec4{pos.x - r, pos.y - r, pos.x + r, pos.y + r},
+                [&](const std::shared_ptr<Entity>& e) {
+                    auto s = dynamic_pointer_cast<T>(e);
+                    if (!s) return EntityHelper::ForEachFlow::Continue;
+                    if (s->contents.find(itemID) == s->contents.end())
+                        return EntityHelper::ForEachFlow::Continue;
+                    if (glm::distance(pos, s->position) < r) {
+                        matching.push_back(s);
+                    }
+                    return EntityHelper::ForEachFlow::None;
+                });
+        };
+
+        if (range >= 0) {
+            collect(range);
+            sortByDistance(pos, matching);
+            return matching;
+        }
+
+        const SpatialHash& g = grid();
+        if (g.empty()) return matching;
+        // once r reaches the furthest corner we have looked at every bucket
+        glm::vec2 lo = glm::vec2{g.bounds.minX, g.bounds.minY} * g.cellSize;
+        glm::vec2 hi =
+            glm::vec2{g.bounds.maxX + 1, g.bounds.maxY + 1} * g.cellSize;
+        float maxR = std::max({
+            glm::distance(pos, lo),
+            glm::distance(pos, hi),
+            glm::distance(pos, glm::vec2{lo.x, hi.y}),
+            glm::distance(pos, glm::vec2{hi.x, lo.y}),
+        });
+        for (float r = g.cellSize; matching.empty(); r *= 2.f) {
+            collect(r);
+            if (r >= maxR) break;
+        }
+        sortByDistance(pos, matching);
+        return matching;
+    }
+
+    // rect is (minx, miny, maxx, maxy)
+    template <typename T>
+    static std::vector<std::shared_ptr<T>> getEntityInSelection(
+        const glm::vec4& rect) {
+        std::vector<std::shared_ptr<T>> matching;
+        grid().forEachInRect(rect, [&](const std::shared_ptr<Entity>& e) {
+            auto s = dynamic_pointer_cast<T>(e);
+            if (!s) return EntityHelper::ForEachFlow::Continue;
+            glm::vec2 lo = glm::min(s->position, s->position + s->size);
+            glm::vec2 hi = glm::max(s->position, s->position + s->size);
+            if (lo.x <= rect.z && hi.x >= rect.x &&  //
+                lo.y <= rect.w && hi.y >= rect.y) {
+                matching.push_back(s);
+            }
+            return EntityHelper::ForEachFlow::None;
+        });
+        return matching;
+    }
+
+    static bool entityInLocation(const glm::vec2& pos, const glm::vec2& sz) {
+        bool found = false;
+        glm::vec2 lo = glm::min(pos, pos + sz);
+        glm::vec2 hi = glm::max(pos, pos + sz);
+        grid().forEachInRect(
+            glm::vec4{lo.x, lo.y, hi.x, hi.y},
+            [&](const std::shared_ptr<Entity>& e) {
+                glm::vec2 elo = glm::min(e->position, e->position + e->size);
+                glm::vec2 ehi = glm::max(e->position, e->position + e->size);
+                if (elo.x < hi.x && ehi.x > lo.x && elo.y < hi.y &&
+                    ehi.y > lo.y) {
+                    found = true;
+                    return EntityHelper::ForEachFlow::Break;
+                }
+                return EntityHelper::ForEachFlow::None;
+            });
+        return found;
+    }
+};
@@ -16,6 +16,10 @@
 #include "entities.h"
 #include "job.h"
 #include "menu.h"
+#include "simulation.h"
+#include "spatial_index.h"
+#include "textures.h"
+#include "view_culling.h"
 
 //
 
@@ -26,16 +30,16 @@ enum FurnitureTool {
     DELETE = 3,
 };
 
-constexpr inline const char* furnitureToolToTexture(FurnitureTool id) {
+constexpr inline TextureHandle furnitureToolToTexture(FurnitureTool id) {
     switch (id) {
         // TODO adda like a red x texture
         case FurnitureTool::DELETE:
         case FurnitureTool::SELECTION:
-            return "white";
+            return Textures::White;
         case FurnitureTool::STORAGE:
-            return "box";
+            return Textures::Box;
         case FurnitureTool::SHELF:
-            return "shelf";
+            return Textures::Shelf;
     }
 }
 
@@ -70,7 +74,7 @@ struct GameUILayer : public Layer {
         uicontext->init();
         GLOBALS.set("selected_tool", &selectedTool);
 
-        itemManager = GLOBALS.get_ptr<ItemManager>("item_manager");
+        itemManager = &ItemManager::get();
     }
 
     virtual ~GameUILayer() {}
@@ -94,35 +98,15 @@ struct GameUILayer : public Layer {
         };
     }
 
-    ItemGroup getTotalInventory() {
-        ItemGroup ig;
-        EntityHelper::forEach<Storable>([&](auto s) {
-            for (auto kv : s->contents) {
-                ig.addItem(kv.first, kv.second);
-            }
-            return EntityHelper::ForEachFlow::None;
-        });
-
-        EntityHelper::forEach<Employee>([&](auto emp) {
-            for (auto kv : emp->inventory) {
-                ig.addItem(kv.first, kv.second);
-            }
-            return EntityHelper::ForEachFlow::None;
-        });
-        return ig;
-    }
-
     void render_item_row(int index, int item_id, int amountInInventory) {
         using namespace IUI;
 
-        std::shared_ptr<Item> item = itemManager->get_ptr(item_id);
-
         // ${price} {name:<{length}}: {amountInInventory}
         auto formatstr = "${0:.2f} {1}({2})";
-        auto str = fmt::format(formatstr,         //
-                               item->price,       //
-                               item->name,        //
-                               amountInInventory  //
+        auto str = fmt::format(formatstr,                    //
+                               itemManager->price(item_id),  //
+                               itemManager->name(item_id),   //
+                               amountInInventory             //
         );
 
         auto plusButtonPosition_raw = glm::vec2{P_FS, 200.f + (P_FS * index)};
@@ -137,8 +121,9 @@ struct GameUILayer : public Layer {
         if (button_with_label(MK_UUID_LOOP(id, IUI::rootID, index), plusButtonConfig)) {
             // TODO should we have a max price
             float MAX_ITEM_PRICE = 10.f;
-            itemManager->update_price(item_id,
-                                      fmin(item->price + 0.1, MAX_ITEM_PRICE));
+            itemManager->update_price(
+                item_id,
+                fmin(itemManager->price(item_id) + 0.1, MAX_ITEM_PRICE));
         }
 
         auto minusButtonConfig = WidgetConfig({
@@ -153,8 +138,9 @@ struct GameUILayer : public Layer {
         if (button_with_label(MK_UUID_LOOP(id, IUI::rootID, index), minusButtonConfig)) {
             // TODO where should this live
             float MIN_ITEM_PRICE = 0.f;
-            itemManager->update_price(item_id,
-                                      fmax(item->price - 0.1, MIN_ITEM_PRICE));
+            itemManager->update_price(
+                item_id,
+                fmax(itemManager->price(item_id) - 0.1, MIN_ITEM_PRICE));
         }
 
         text(MK_UUID_LOOP(id, 0, index),
@@ -194,9 +180,12 @@ struct GameUILayer : public Layer {
             text(MK_UUID(id, IUI::rootID), textConfig);
 
             // TODO replace with list view when exists
+            // shelves, storage and whatever employees are carrying
+            const InventoryLedger& ledger = InventoryLedger::get();
             int i = 0;
-            for (auto kv : getTotalInventory()) {
-                render_item_row(i++, kv.first, kv.second);
+            for (int id = 0; id < ledger.numItems(); id++) {
+                if (ledger.total(id) == 0) continue;
+                render_item_row(i++, id, ledger.total(id));
             }
         }
         std::vector<WidgetConfig> dropdownConfigs;
@@ -248,6 +237,7 @@ struct SuperLayer : public Layer {
     std::shared_ptr<DragArea> dragArea;
     glm::vec4 viewport = {0, 0, WIN_W, WIN_H};
     std::shared_ptr<OrthoCameraController> cameraController;
+    Simulation sim;
 
     SuperLayer() : Layer("Supermarket") {
         isMinimized = true;
@@ -259,79 +249,33 @@ struct SuperLayer : public Layer {
         cameraController->camera.setViewport(viewport);
         cameraController->rotationEnabled = false;
 
-        Renderer::addTexture("./resources/face.png");
-        Renderer::addTexture("./resources/box.png");
-        Renderer::addTexture("./resources/shelf.png");
-        Renderer::addTexture("./resources/screen.png");
+        Textures::add("./resources/face.png");
+        Textures::add("./resources/box.png");
+        Textures::add("./resources/shelf.png");
+        Textures::add("./resources/screen.png");
 
         // 918 × 203 pixels at 16 x 16 with margin 1
         float playerSprite = 16.f;
-        Renderer::addTexture("./resources/character_tilesheet.png");
-        Renderer::addSubtexture("character_tilesheet", "player", 0, 0,
+        Textures::add("./resources/character_tilesheet.png");
+        Textures::addSubtexture("character_tilesheet", "player", 0, 0,
                                 playerSprite, playerSprite);
-        Renderer::addSubtexture("character_tilesheet", "player2", 0, 1,
+        Textures::addSubtexture("character_tilesheet", "player2", 0, 1,
                                 playerSprite, playerSprite);
-        Renderer::addSubtexture("character_tilesheet", "player3", 1, 1,
+        Textures::addSubtexture("character_tilesheet", "player3", 1, 1,
                                 playerSprite, playerSprite);
 
-        Renderer::addTexture("./resources/item_sheet.png");
-        Renderer::addSubtexture("item_sheet", "egg", 0, 0, 16.f, 16.f);
-        Renderer::addSubtexture("item_sheet", "milk", 1, 0, 16.f, 16.f);
-        Renderer::addSubtexture("item_sheet", "peanutbutter", 2, 0, 16.f, 16.f);
-        Renderer::addSubtexture("item_sheet", "pizza", 3, 0, 16.f, 16.f);
+        Textures::add("./resources/item_sheet.png");
+        Textures::addSubtexture("item_sheet", "egg", 0, 0, 16.f, 16.f);
+        Textures::addSubtexture("item_sheet", "milk", 1, 0, 16.f, 16.f);
+        Textures::addSubtexture("item_sheet", "peanutbutter", 2, 0, 16.f, 16.f);
+        Textures::addSubtexture("item_sheet", "pizza", 3, 0, 16.f, 16.f);
 
         ////////////////////////////////////////////////////////
 
         // NOTE: Superlayer owns this static so its okay to use directly
         GLOBALS.set("navmesh", &__navmesh___DO_NOT_USE_DIRECTLY);
 
-        for (int i = 0; i < 5; i++) {
-            for (int j = 0; j < 10; j += 2) {
-                if (i == 0 && j == 4) {
-                    continue;
-                }
-                auto shelf2 = std::make_shared<Shelf>(
-                    glm::vec2{1.f + i, -3.f + j},  //
-                    glm::vec2{1.f, 1.f}, 0.f,      //
-                    glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}, "shelf");
-                EntityHelper::addEntity(shelf2);
-            }
-        }
-
-        auto storage = std::make_shared<Storage>(
-            glm::vec2{1.f, 1.f}, glm::vec2{1.f, 1.f}, 0.f,
-            glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}, "box");
-        storage->contents.addItem(0, 1);
-        storage->contents.addItem(1, 6);
-        storage->contents.addItem(2, 7);
-        storage->contents.addItem(3, 9);
-        EntityHelper::addEntity(storage);
-
-        const int num_people_sprites = 3;
-        std::array<std::string, num_people_sprites> peopleSprites = {
-            "player",
-            "player2",
-            "player3",
-        };
-
-        for (int i = 0; i < 1; i++) {
-            auto emp = Employee();
-            emp.color = gen_rand_vec4(0.3f, 1.0f);
-            emp.color.w = 1.f;
-            emp.size = {0.6f, 0.6f};
-            emp.textureName = peopleSprites[0];
-            EntityHelper::addEntity(std::make_shared<Employee>(emp));
-        }
-
-        for (int i = 0; i < 1; i++) {
-            auto cust = Customer();
-            cust.color = gen_rand_vec4(0.3f, 1.0f);
-            cust.color.w = 1.f;
-            cust.size = {0.6f, 0.6f};
-            cust.textureName =
-                peopleSprites[(i % (num_people_sprites - 1)) + 1];
-            EntityHelper::addEntity(std::make_shared<Customer>(cust));
-        }
+        sim.setup();
 
         dragArea.reset(new DragArea(glm::vec2{0.f}, glm::vec2{0.f}, 0.f,
                                     glm::vec4{0.75f}));
@@ -347,23 +291,21 @@ struct SuperLayer : public Layer {
             cameraController->onUpdate(dt);
         }
 
-        EntityHelper::forEachEntity([&](auto entity) {  //
-            entity->onUpdate(dt);
-            return EntityHelper::ForEachFlow::None;
-        });
-
+        sim.update(dt);  // move things around
         dragArea->onUpdate(dt);
     }
 
     void render() {
         Renderer::begin(cameraController->camera);
+        ViewCulling::stats() = CullStats();
+        glm::vec4 onScreen =
+            ViewCulling::visibleRect(cameraController->camera.view,
+                                     cameraController->camera.projection);
         // should go underneath entities also
-        dragArea->render_selected();
+        dragArea->render_selected(onScreen);
 
-        EntityHelper::forEachEntity([&](auto entity) {  //
-            entity->render();
-            return EntityHelper::ForEachFlow::None;
-        });
+        ViewCulling::forEachEntityIn(
+            onScreen, [](const auto& entity) { entity->render(); });
 
         // render above items
         dragArea->render();
@@ -371,44 +313,6 @@ struct SuperLayer : public Layer {
         Renderer::end();
     }
 
-    void fillJobQueue() {
-        if (JobQueue::numOfJobsWithType(JobType::IdleWalk) < 5) {
-            JobQueue::addJob(
-                JobType::IdleWalk,
-                std::make_shared<Job>(
-                    Job({.type = JobType::IdleWalk,
-                         .endPosition = glm::circularRand<float>(5.f)})));
-        }
-
-        if (JobQueue::numOfJobsWithType(JobType::IdleShop) < 5) {
-            JobQueue::addJob(
-                JobType::IdleShop,
-                std::make_shared<Job>(
-                    Job({.type = JobType::IdleShop,
-                         .endPosition = glm::circularRand<float>(5.f)})));
-        }
-
-        EntityHelper::forEach<Storage>([](auto storage) {
-            // TODO for now just keep queue jobs until we are empty
-            if (!storage->contents.empty() &&
-                JobQueue::numOfJobsWithType(JobType::Fill) <
-                    (int)storage->contents.size()) {
-                // TODO getting random shelf probably not the best
-                // idea.. .
-                Job j = {
-                    .type = JobType::Fill,
-                    .startPosition = storage->position,
-                    .endPosition =
-                        EntityHelper::getRandomEntity<Shelf>()->position,
-                    .itemID = storage->contents.rbegin()->first,
-                    .itemAmount = storage->contents.rbegin()->second,
-                };
-                JobQueue::addJob(JobType::Fill, std::make_shared<Job>(j));
-            }
-            return EntityHelper::ForEachFlow::None;
-        });
-    }
-
     glm::vec3 getMouseInWorld() {
         auto mouse = Input::getMousePosition();
         return screenToWorld(glm::vec3{mouse.x, WIN_H - mouse.y, 0.f},
@@ -424,10 +328,9 @@ struct SuperLayer : public Layer {
             dragArea->onDragStart(mouseInWorld);
         }
         if (e.GetMouseButton() == Mouse::MouseCode::ButtonRight) {
-            JobQueue::addJob(
-                JobType::DirectedWalk,
-                std::make_shared<Job>(Job({.type = JobType::DirectedWalk,
-                                           .endPosition = mouseInWorld})));
+            JobQueue::addJob(JobType::DirectedWalk,
+                             Job({.type = JobType::DirectedWalk,
+                                  .endPosition = mouseInWorld}));
         }
         return false;
     }
@@ -467,11 +370,9 @@ struct SuperLayer : public Layer {
         log_trace("{:.2}s ({:.2} ms) ", dt.s(), dt.ms());
         prof give_me_a_name(__PROFILE_FUNC__);
 
-        child_updates(dt);        // move things around
-        render();                 // draw everything
-        fillJobQueue();           // add more jobs if needed
-        JobQueue::cleanup();      // Cleanup all completed jobs
-        EntityHelper::cleanup();  // Cleanup dead entities
+        child_updates(dt);   // move things around
+        render();            // draw everything
+        sim.endOfFrame();    // more jobs, drop dead entities
     }
 
     virtual void onEvent(Event& event) override {
@@ -6,6 +6,17 @@
 #include "../vendor/supermarket-engine/engine/thetastar.h"
 #include "../vendor/supermarket-engine/engine/trie.h"
 #include "entities.h"
+#include "entity_update.h"
+#include "flow_field.h"
+#include "movement.h"
+#include "occupancy_grid.h"
+#include "path_hierarchy.h"
+#include "path_service.h"
+#include "rng.h"
+#include "spatial_index.h"
+#include "text_cache.h"
+#include "textures.h"
+#include "view_culling.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
@@ -69,10 +80,868 @@ void point_collision_test() {
     M_ASSERT(shelf->pointCollides(glm::vec2{2.0001f, 3.f}) == false, "200013");
 }
 
+void spatial_hash_test() {
+    // Uses its own grid so we dont clobber the real one
+    SpatialHash grid(2.f);
+    auto make_shelf = [](glm::vec2 pos, glm::vec2 size) {
+        return std::make_shared<Shelf>(pos, size, 0.f, glm::vec4{1.f}, "box");
+    };
+    auto count_in = [&](glm::vec4 rect) {
+        int n = 0;
+        grid.forEachInRect(rect, [&](auto) {
+            n++;
+            return EntityHelper::ForEachFlow::None;
+        });
+        return n;
+    };
+
+    auto a = make_shelf({0.f, 0.f}, {1.f, 1.f});
+    auto b = make_shelf({-5.f, -5.f}, {1.f, 1.f});
+    // spans 4x2 cells, should still only be reported once
+    auto c = make_shelf({3.f, 3.f}, {6.f, 2.f});
+    grid.insert(a);
+    grid.insert(b);
+    grid.insert(c);
+
+    M_ASSERT(count_in({-1.f, -1.f, 1.f, 1.f}) == 1, "a only");
+    M_ASSERT(count_in({-10.f, -10.f, 10.f, 10.f}) == 3, "all 3 once each");
+    M_ASSERT(count_in({6.f, 4.f, 8.f, 4.5f}) == 1, "middle of c");
+    M_ASSERT(count_in({20.f, 20.f, 30.f, 30.f}) == 0, "nothing out there");
+
+    // move a next to b, it should be found there and not at the origin
+    a->position = {-5.f, -4.f};
+    M_ASSERT(grid.update(a), "a changed cells");
+    M_ASSERT(!grid.update(a), "a didnt move again");
+    M_ASSERT(count_in({-1.f, -1.f, 1.f, 1.f}) == 0, "a moved away");
+    M_ASSERT(count_in({-6.f, -6.f, -4.f, -4.f}) == 2, "a and b");
+
+    grid.remove(c->id);
+    M_ASSERT(count_in({-10.f, -10.f, 10.f, 10.f}) == 2, "c removed");
+    M_ASSERT(grid.size() == 2, "2 left");
+}
+
+void occupancy_grid_test() {
+    OccupancyGrid grid(0.125f);
+    std::vector<glm::vec4> boxes = {
+        {1.f, 0.f, 1.f, 1.f},
+        {3.f, 0.f, 1.f, 1.f},
+        {1.f, 2.f, 3.f, 1.f},
+        {40.f, 40.f, 1.f, 1.f},  // forces the grid to grow
+    };
+    for (size_t i = 0; i < boxes.size(); i++) {
+        grid.add((int)i, {boxes[i].x, boxes[i].y}, {boxes[i].z, boxes[i].w});
+    }
+
+    auto exact = [&](glm::vec2 pos, glm::vec2 size) {
+        for (auto& b : boxes) {
+            if (pos.x < b.x + b.z && pos.x + size.x > b.x &&
+                pos.y < b.y + b.w && pos.y + size.y > b.y)
+                return false;
+        }
+        return true;
+    };
+
+    glm::vec2 agent = {0.6f, 0.6f};
+    // we are allowed to be off by one sub tile but only in the safe direction
+    glm::vec2 grown = agent + glm::vec2{2.f * grid.resolution};
+    glm::vec2 shift = glm::vec2{grid.resolution};
+    for (float x = -2.f; x < 6.f; x += 0.05f) {
+        for (float y = -2.f; y < 5.f; y += 0.05f) {
+            glm::vec2 p = {x, y};
+            bool walkable = grid.isWalkable(p, agent);
+            if (!exact(p, agent))
+                M_ASSERT(!walkable, "grid said walkable inside furniture");
+            if (exact(p - shift, grown))
+                M_ASSERT(walkable, "grid blocked a clearly open spot");
+        }
+    }
+    // the aisle between the two rows is only 0.4 wide for this agent
+    M_ASSERT(grid.isWalkable({2.f, 1.1f}, agent), "aisle should be open");
+
+    grid.remove(2);
+    boxes.erase(boxes.begin() + 2);
+    M_ASSERT(grid.isWalkable({2.f, 2.f}, agent), "removed box should be open");
+    M_ASSERT(!grid.isWalkable({1.f, 0.f}, agent), "neighbor still there");
+    M_ASSERT(!grid.isWalkable({40.5f, 40.5f}, agent), "far box still there");
+
+    int version = grid.version;
+    M_ASSERT(grid.isWalkableReadOnly({1.f, 0.f}, {2.f, 2.f}) &&
+                 grid.version == version && !grid.findLayer({2.f, 2.f}),
+             "read only check doesnt build a layer");
+    M_ASSERT(!grid.isWalkableReadOnly({1.f, 0.f}, agent), "uses the layer");
+
+    // 0.55 is between two sub tiles, the layer has to round up
+    auto key = grid.layerKey({0.55f, 0.5f});
+    M_ASSERT(key.first == 5 && key.second == 4, "layers cover the agent");
+    M_ASSERT(!grid.isWalkable({0.46f, 0.f}, {0.55f, 0.5f}),
+             "grid said walkable inside furniture");
+}
+
+void path_service_test() {
+    PathService& service = PathService::get();
+    for (bool useWorkers : {false, true}) {
+        service.useWorkers = useWorkers;
+        auto ticket = service.submit({0.f, 0.f}, {6.f, 0.f}, {0.6f, 0.6f});
+        while (!ticket->done) std::this_thread::yield();
+        M_ASSERT(ticket->path && ticket->path->size(),
+                 "Path is empty but shouldnt be");
+
+        auto cancelled = service.submit({0.f, 0.f}, {6.f, 0.f}, {0.6f, 0.6f});
+        cancelled->cancelled = true;
+        while (!cancelled->done) std::this_thread::yield();
+    }
+    service.useWorkers = true;
+}
+
+void path_cache_ends_test() {
+    OccupancyGrid grid(0.125f);
+    grid.add(1, {1.f, 0.f}, {1.f, 1.f});
+    const OccupancyGrid::Layer& layer = grid.layerFor({0.6f, 0.6f});
+    std::vector<glm::vec2> path = {{0.f, 2.f}, {3.f, 2.f}};
+
+    M_ASSERT(PathService::endsWalkable(grid, layer, path, {0.1f, 2.1f},
+                                       {3.1f, 2.f}),
+             "nearby ends are fine");
+    M_ASSERT(!PathService::endsWalkable(grid, layer, path, {0.f, 2.f},
+                                        {3.f, -0.2f}),
+             "last bit to our end cuts through the box");
+    std::vector<glm::vec2> around = {{3.f, -0.2f}, {3.f, 2.f}};
+    M_ASSERT(!PathService::endsWalkable(grid, layer, around, {0.f, -0.2f},
+                                        {3.f, 2.f}),
+             "first bit from our start cuts through the box");
+}
+
+void path_cache_test() {
+    PathCache cache(2);
+    glm::vec2 size = {0.6f, 0.6f};
+    SharedPath path = makeSharedPath({{0.f, 0.f}, {2.f, 3.f}, {6.f, 0.f}});
+
+    M_ASSERT(!cache.get({0.f, 0.f}, {6.f, 0.f}, size), "empty cache");
+    cache.put({0.f, 0.f}, {6.f, 0.f}, size, path);
+    M_ASSERT(cache.get({0.1f, 0.1f}, {6.2f, 0.1f}, size), "close enough");
+    M_ASSERT(!cache.get({0.f, 0.f}, {6.f, 0.f}, {1.f, 1.f}), "other size");
+
+    // only paths going through the box get dropped
+    cache.put({10.f, 10.f}, {12.f, 10.f}, size,
+              makeSharedPath({{10.f, 10.f}, {12.f, 10.f}}));
+    cache.invalidate({1.f, 1.f, 2.f, 2.f});
+    M_ASSERT(!cache.get({0.f, 0.f}, {6.f, 0.f}, size), "invalidated");
+    M_ASSERT(cache.get({10.f, 10.f}, {12.f, 10.f}, size), "untouched");
+
+    // capacity 2, the least recently used should go
+    cache.put({0.f, 0.f}, {6.f, 0.f}, size, path);
+    cache.get({10.f, 10.f}, {12.f, 10.f}, size);
+    cache.put({20.f, 20.f}, {22.f, 20.f}, size, makeSharedPath({{20.f, 20.f}}));
+    M_ASSERT(cache.size() == 2, "over capacity");
+    M_ASSERT(!cache.get({0.f, 0.f}, {6.f, 0.f}, size), "lru evicted");
+    M_ASSERT(cache.evicted == 1, "one eviction");
+
+    // agents share the cached points and each finish where they asked to
+    SharedPath shared = cache.get({10.f, 10.f}, {12.f, 10.f}, size);
+    PathCursor a(shared, {12.f, 10.f});
+    PathCursor b(shared, {12.2f, 10.1f});
+    M_ASSERT(a.size() == 2 && a.front() == glm::vec2(10.f, 10.f), "start");
+    a.pop();
+    b.pop();
+    M_ASSERT(a.front() == glm::vec2(12.f, 10.f), "exact end");
+    M_ASSERT(b.front() == glm::vec2(12.2f, 10.1f), "own end");
+    M_ASSERT(shared->back() == glm::vec2(12.f, 10.f), "shared path untouched");
+    a.pop();
+    M_ASSERT(a.empty() && !a.points, "lets go once done");
+}
+
+void flow_field_test() {
+    // wall from y=-5 to y=4 at x=3, have to go around the top
+    OccupancyGrid grid(0.125f);
+    grid.add(0, {3.f, -5.f}, {1.f, 9.f});
+    glm::vec2 agent = {0.6f, 0.6f};
+    auto& layer = grid.layerFor(agent);
+
+    glm::vec2 goal = {6.f, 0.f};
+    FlowField field = FlowField::build(grid, layer, goal);
+    M_ASSERT(!field.empty(), "field should cover the goal");
+
+    glm::vec2 pos = {0.f, 0.f};
+    bool reached = false;
+    for (int i = 0; i < 1000 && !reached; i++) {
+        auto target = field.target(pos, goal);
+        M_ASSERT(target, "we should stay inside the field");
+        // step straight at it, a bit at a time
+        glm::vec2 delta = *target - pos;
+        float len = glm::length(delta);
+        pos = len < 0.05f ? *target : pos + delta * (0.05f / len);
+        M_ASSERT(grid.isWalkable(pos, agent), "walked into the wall");
+        reached = glm::distance(pos, goal) < TRAVEL_DIST;
+    }
+    M_ASSERT(reached, "never got to the goal");
+    M_ASSERT(!field.target({100.f, 100.f}, goal), "outside the field");
+}
+
+void path_hierarchy_test() {
+    // walls every 10 tiles with the gap alternating top / bottom, way past
+    // the old -20..20 search bounds
+    OccupancyGrid grid(0.125f);
+    for (int i = 0; i < 6; i++) {
+        float y = i % 2 == 0 ? 0.f : 4.f;
+        grid.add(i, {10.f * (i + 1), y}, {1.f, 36.f});
+    }
+    glm::vec2 agent = {0.6f, 0.6f};
+    auto& layer = grid.layerFor(agent);
+    PathHierarchy::refresh(grid);
+
+    auto check = [&](const std::vector<glm::vec2>& path, glm::vec2 start,
+                     glm::vec2 end) {
+        M_ASSERT(path.size() > 2, "should have to go around the walls");
+        M_ASSERT(path.front() == start && path.back() == end, "endpoints");
+        for (size_t i = 1; i < path.size(); i++) {
+            M_ASSERT(PathHierarchy::lineOfSight(grid, layer, path[i - 1],
+                                                path[i]),
+                     "path walks through a wall");
+        }
+    };
+    glm::vec2 start = {0.f, 20.f};
+    glm::vec2 end = {75.f, 20.f};
+    check(PathHierarchy::findPath(grid, layer, start, end), start, end);
+
+    auto clusterAt = [&](float x, float y) {
+        return layer.nav.clusters.at(
+            NavGraph::key(NavGraph::toCluster(NavGraph::toNav(grid.toCell(x))),
+                          NavGraph::toCluster(NavGraph::toNav(grid.toCell(y)))));
+    };
+
+    // close the first gap, only the clusters around it get rebuilt
+    auto far = clusterAt(70.f, 20.f);
+    grid.add(6, {10.f, 36.f}, {1.f, 4.f});
+    M_ASSERT(!layer.nav.ready(), "adding should mark clusters dirty");
+    PathHierarchy::refresh(grid);
+    M_ASSERT(clusterAt(70.f, 20.f) == far, "far cluster was rebuilt");
+
+    // same when the grid has to grow
+    auto middle = clusterAt(40.f, 20.f);
+    grid.add(7, {120.f, 20.f}, {1.f, 1.f});
+    PathHierarchy::refresh(grid);
+    M_ASSERT(clusterAt(40.f, 20.f) == middle, "growing rebuilt everything");
+    auto around = PathHierarchy::findPath(grid, layer, start, end);
+    check(around, start, end);
+    bool wentOutside = false;
+    for (auto& p : around) wentOutside |= p.y > 39.f || p.y < 0.f;
+    M_ASSERT(wentOutside, "gap is closed, has to go around the end");
+}
+
+void job_queue_test() {
+    JobQueue::clear();
+    auto make = [](JobType t, int reserved = -1) {
+        return JobQueue::addJob(t, Job({.type = t, .reserved = reserved}));
+    };
+    // same as Employee / Customer::getJobRange
+    JobRange employee = {JobType::None, JobType::INVALID_Customer_Boundary};
+    JobRange customer = {JobType::INVALID_Customer_Boundary,
+                         JobType::MAX_JOB_TYPE};
+
+    auto walk1 = make(JobType::IdleWalk);
+    auto walk2 = make(JobType::IdleWalk);
+    auto fill = make(JobType::Fill);
+    auto mine = make(JobType::FindItem, 7);
+    auto shop = make(JobType::IdleShop);
+    M_ASSERT(!JobQueue::getNextInRange(1, employee), "not flushed yet");
+    JobQueue::flush();
+
+    // highest type first, then oldest first
+    M_ASSERT(JobQueue::getNextInRange(1, employee) == fill, "fill first");
+    M_ASSERT(JobQueue::getNextInRange(1, employee) == walk1, "fifo");
+    M_ASSERT(JobQueue::getNextInRange(1, employee) == walk2, "fifo");
+    M_ASSERT(!JobQueue::getNextInRange(1, employee), "nothing left");
+    M_ASSERT(JobQueue::get(walk1)->isAssigned(), "picked jobs are assigned");
+    M_ASSERT(JobQueue::numOfJobsWithType(JobType::IdleWalk) == 2, "count");
+    M_ASSERT(JobQueue::numAssignedWithType(JobType::IdleWalk) == 2, "assigned");
+
+    // reserved jobs only go to the entity they are for
+    M_ASSERT(JobQueue::getNextInRange(2, customer) == shop, "not reserved");
+    M_ASSERT(!JobQueue::getNextInRange(2, customer), "reserved for 7");
+    M_ASSERT(JobQueue::getNextInRange(7, customer) == mine, "reserved");
+
+    JobQueue::complete(walk1);
+    JobQueue::complete(walk1);
+    M_ASSERT(!JobQueue::get(walk1), "handle is stale once complete");
+    M_ASSERT(JobQueue::numOfJobsWithType(JobType::IdleWalk) == 1, "removed");
+    M_ASSERT(JobQueue::numAssignedWithType(JobType::IdleWalk) == 1, "removed");
+
+    // completing a job nobody picked up takes it out of the middle
+    auto a = make(JobType::Empty);
+    auto b = make(JobType::Empty);
+    auto c = make(JobType::Empty);
+    JobQueue::complete(b);
+    JobQueue::flush();
+    M_ASSERT(JobQueue::getNextInRange(1, employee) == a, "a");
+    M_ASSERT(JobQueue::getNextInRange(1, employee) == c, "b was skipped");
+
+    // completed slots get reused once flushed, old handles dont resolve to
+    // the new job
+    auto d = make(JobType::Empty);
+    M_ASSERT(d.index == b.index && d != b, "b's slot, new generation");
+    M_ASSERT(!JobQueue::get(b) && JobQueue::get(d), "only d resolves");
+
+    // churn doesnt grow the pool
+    int capacity = JobQueue::data().pool.capacity();
+    for (int i = 0; i < 10000; i++) {
+        JobQueue::complete(make(JobType::IdleWalk));
+        JobQueue::flush();
+    }
+    M_ASSERT(JobQueue::data().pool.capacity() == capacity, "no new chunks");
+    JobQueue::clear();
+}
+
+// Workers add, claim, put back and complete jobs all at the same time, one
+// tick at a time with a flush in between like SuperLayer. Nobody can ever
+// hold a job someone else holds and every job gets completed exactly once.
+//
+// Runs small on every launch, STRESS_TESTS=1 ./super.exe for the full
+// 80k jobs
+void job_queue_stress_test(int ticks, int perTick) {
+    JobQueue::clear();
+    const int numThreads = 4;
+    const int total = numThreads * ticks * perTick;
+    JobRange employee = {JobType::None, JobType::INVALID_Customer_Boundary};
+    const JobType types[] = {JobType::IdleWalk, JobType::Empty,
+                             JobType::Fill};
+
+    std::vector<std::atomic<bool>> held(total);
+    std::vector<std::atomic<int>> done(total);
+    std::atomic<int> completed{0};
+
+    // returns false once there was nothing to claim
+    auto work = [&](int e_id, int i) {
+        JobHandle h = JobQueue::getNextInRange(e_id, employee);
+        if (!h) return false;
+        Job* j = JobQueue::get(h);
+        M_ASSERT(j->reserved == -1 || j->reserved == e_id, "not ours");
+        M_ASSERT(!held[j->itemID].exchange(true), "claimed twice");
+        int id = j->itemID;
+        if (i % 4 == 0) {
+            // put some back so they get fought over again
+            held[id] = false;
+            JobQueue::unassign(h);
+            return true;
+        }
+        held[id] = false;
+        done[id]++;
+        completed++;
+        JobQueue::complete(h);
+        return true;
+    };
+
+    for (int tick = 0; tick < ticks; tick++) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.emplace_back([&, t, tick]() {
+                for (int i = 0; i < perTick; i++) {
+                    int id = (tick * numThreads + t) * perTick + i;
+                    JobType type = types[id % 3];
+                    int reserved = id % 5 == 0 ? id % numThreads : -1;
+                    JobQueue::addJob(type, Job({.type = type,
+                                                .reserved = reserved,
+                                                .itemID = id}));
+                    // new jobs arent visible till the flush so everyone
+                    // is fighting over the ones from last tick
+                    work(t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        JobQueue::flush();
+    }
+
+    for (int t = 0; t < numThreads; t++) {
+        for (int i = 1;; i++) {
+            if (!work(t, i)) break;
+        }
+    }
+    JobQueue::flush();
+
+    M_ASSERT(completed == total, "everything got done");
+    for (int i = 0; i < total; i++) M_ASSERT(done[i] == 1, "exactly once");
+    for (JobType t : types) {
+        M_ASSERT(JobQueue::numOfJobsWithType(t) == 0, "count");
+        M_ASSERT(JobQueue::numAssignedWithType(t) == 0, "assigned");
+        M_ASSERT(JobQueue::openJobs(t).empty(), "list is empty");
+    }
+    M_ASSERT(JobQueue::data().pool.numUsed == 0, "all slots released");
+    JobQueue::clear();
+}
+
+void job_assigner_test() {
+    JobQueue::clear();
+    JobAssigner& assigner = JobAssigner::get();
+    JobRange employee = {JobType::None, JobType::INVALID_Customer_Boundary};
+    auto make = [](JobType t, glm::vec2 start, int reserved = -1) {
+        return JobQueue::addJob(t, Job({.type = t,
+                                        .reserved = reserved,
+                                        .startPosition = start,
+                                        .endPosition = start}));
+    };
+
+    // both ask at the same time, each should get the one next to them
+    auto far = make(JobType::Fill, {9.f, 0.f});
+    auto near = make(JobType::Fill, {1.f, 0.f});
+    assigner.request(1, {0.f, 0.f}, employee);
+    assigner.request(2, {10.f, 0.f}, employee);
+    assigner.assign();
+    M_ASSERT(assigner.take(1) == near, "1 is next to near");
+    M_ASSERT(assigner.take(2) == far, "2 is next to far");
+
+    // priority still beats distance
+    auto walk = make(JobType::IdleWalk, {0.f, 0.f});
+    auto fill = make(JobType::Fill, {50.f, 0.f});
+    assigner.request(1, {0.f, 0.f}, employee);
+    assigner.assign();
+    M_ASSERT(assigner.take(1) == fill, "fill is higher priority");
+
+    // reserved jobs only go to their owner, even if someone is closer
+    auto mine = make(JobType::Empty, {0.f, 0.f}, 3);
+    assigner.request(1, {0.f, 0.f}, {JobType::Empty, JobType::Empty});
+    assigner.request(3, {30.f, 0.f}, {JobType::Empty, JobType::Empty});
+    assigner.assign();
+    M_ASSERT(!assigner.take(1), "not for 1");
+    M_ASSERT(assigner.take(3) == mine, "reserved for 3");
+
+    // if nobody comes to pick it up it goes back in the queue
+    assigner.request(4, {0.f, 0.f}, employee);
+    assigner.assign();
+    M_ASSERT(JobQueue::get(walk)->isAssigned(), "handed out");
+    assigner.assign();
+    M_ASSERT(!JobQueue::get(walk)->isAssigned(), "returned");
+    M_ASSERT(JobQueue::getNextInRange(1, employee) == walk, "back in line");
+
+    // same distance goes to whichever was queued first, not by address
+    auto first = make(JobType::Fill, {-2.f, 0.f});
+    make(JobType::Fill, {2.f, 0.f});
+    assigner.request(1, {0.f, 0.f}, employee);
+    assigner.assign();
+    M_ASSERT(assigner.take(1) == first, "ties go to the front of the queue");
+
+    assigner.clear();
+    JobQueue::clear();
+}
+
+// Everyone grabs from the same shelf and steps right each tick. However many
+// threads do the thinking the result has to match, with the first entities
+// in line getting the items and nobody seeing anyone move until the tick
+// is applied
+void entity_update_test() {
+    struct Grabber : public Entity {
+        ItemGroup* shelf = nullptr;
+        ItemGroup hands;
+        Entity* first = nullptr;
+        int got = 0;
+        std::vector<float> seen;
+
+        virtual void onUpdate(Time) override {
+            seen.push_back(first->position.x);
+            Intents::transfer(*this, *shelf, hands, 1, 1,
+                              [this](int amt) { got += amt; });
+            Intents::move(*this, position + glm::vec2{1.f, 0.f});
+        }
+        virtual const char* typeString() const override { return "Grabber"; }
+    };
+
+    const int numGrabbers = 200;
+    const int ticks = 3;
+    auto run = [&](int numWorkers) {
+        EntityUpdater updater;
+        updater.pool.numWorkers = numWorkers;
+        ItemGroup shelf;
+        shelf.addItem(1, 250);
+
+        std::vector<std::shared_ptr<Entity>> entities;
+        std::vector<std::shared_ptr<Grabber>> grabbers;
+        for (int i = 0; i < numGrabbers; i++) {
+            auto g = std::make_shared<Grabber>();
+            g->shelf = &shelf;
+            g->position = {0.f, (float)i};
+            g->first = grabbers.empty() ? g.get() : grabbers[0].get();
+            grabbers.push_back(g);
+            entities.push_back(g);
+        }
+        for (int t = 0; t < ticks; t++) updater.update(entities, Time(0.016f));
+
+        std::vector<int> got;
+        for (auto& g : grabbers) {
+            M_ASSERT(g->position.x == (float)ticks, "moved once a tick");
+            for (int t = 0; t < ticks; t++) {
+                M_ASSERT(g->seen[t] == (float)t, "world is frozen");
+            }
+            M_ASSERT(g->hands.count(1) == g->got, "got what was moved");
+            got.push_back(g->got);
+        }
+        M_ASSERT(shelf.count(1) == 0, "shelf is empty");
+        return got;
+    };
+
+    auto serial = run(0);
+    // 250 items: everyone gets one on the first tick, the first 50 get a
+    // second one and the rest find the shelf empty
+    for (int i = 0; i < numGrabbers; i++) {
+        M_ASSERT(serial[i] == (i < 50 ? 2 : 1), "first in line wins");
+    }
+    M_ASSERT(run(4) == serial, "same result with threads");
+}
+
+void movement_test() {
+    struct Walker : public MovableEntity {
+        virtual const char* typeString() const override { return "Walker"; }
+    };
+    MovementStore& store = MovementStore::get();
+    auto a = std::make_shared<Walker>();
+    auto b = std::make_shared<Walker>(*a);
+    M_ASSERT(a->movement.index != b->movement.index,
+             "copies get their own slot");
+
+    a->position = {0.f, 0.f};
+    b->position = {10.f, 0.f};
+    store.request(a->movement.index, a.get(), {1.f, 0.f});
+    store.integrate(0.016f);
+    M_ASSERT(a->position.x == lerp({0.f, 0.f}, {1.f, 0.f}, 0.05f).x,
+             "first move happens right away");
+    M_ASSERT(b->position.x == 10.f, "didnt ask so didnt move");
+
+    glm::vec2 before = a->position;
+    store.request(a->movement.index, a.get(), {1.f, 0.f});
+    store.integrate(0.016f);
+    M_ASSERT(a->position == before, "waits betweenMoves before the next one");
+    store.request(a->movement.index, a.get(), {1.f, 0.f});
+    store.integrate(0.016f);
+    M_ASSERT(a->position.x > before.x, "then moves again");
+
+    int slot = b->movement.index;
+    b.reset();
+    M_ASSERT(store.owner[slot] == nullptr, "slot is freed with its entity");
+}
+
+void item_group_test() {
+    ItemGroup g;
+    M_ASSERT(g.empty() && g[3] == 0, "missing id is 0, not a crash");
+    for (int id : {5, 1, 3, 1}) g.addItem(id, 2);
+    M_ASSERT(g.size() == 3 && g.count(1) == 4, "added up");
+    std::vector<int> ids;
+    for (auto kv : g) ids.push_back(kv.first);
+    M_ASSERT(ids == std::vector<int>({1, 3, 5}), "sorted by id");
+    M_ASSERT(g.rbegin()->first == 5, "rbegin is the biggest id");
+    M_ASSERT(!g.group.onHeap(), "small groups stay inline");
+
+    M_ASSERT(g.removeItem(3, 5) == 2 && g.find(3) == g.end(),
+             "taking too many takes what is there");
+    M_ASSERT(g.removeItem(7, 1) == 0, "cant remove what isnt there");
+
+    ItemGroup big;
+    for (int id = 20; id > 0; id--) big.addItem(id, id);
+    M_ASSERT(big.group.onHeap() && big.size() == 20, "spills past inline");
+    for (int id = 1; id <= 20; id++) {
+        M_ASSERT(big[id] == id, "every id still found");
+    }
+    ItemGroup copy = big;
+    big.addItem(1, 100);
+    M_ASSERT(copy[1] == 1, "copies dont share");
+    ItemGroup moved = std::move(big);
+    M_ASSERT(moved[1] == 101 && big.empty(), "move takes everything");
+
+    g.merge(copy);
+    M_ASSERT(g.size() == 20 && g[1] == 5 && g[5] == 7 && g[20] == 20,
+             "merge adds matching ids");
+    ItemGroup few;
+    few.addItem(1, 1);
+    few.addItem(25, 1);
+    copy.merge(few);
+    M_ASSERT(copy.size() == 21 && copy[1] == 2 && copy[25] == 1 &&
+                 copy.rbegin()->first == 25,
+             "small into big merge keeps it sorted");
+}
+
+void inventory_ledger_test() {
+    const InventoryLedger& ledger = InventoryLedger::get();
+    // other tests might have left shelves around, only look at changes
+    const int id = 7;
+    int before = ledger.total(id);
+    int onShelves = ledger.total(id, ItemLocation::Shelf);
+    int withEmployees = ledger.total(id, ItemLocation::Employee);
+    {
+        Shelf shelf({0.f, 0.f}, {1.f, 1.f}, 0.f, glm::vec4{1.f}, "shelf");
+        ItemGroup hands(ItemLocation::Employee);
+        ItemGroup cart;
+        shelf.contents.addItem(id, 10);
+        M_ASSERT(ledger.total(id) == before + 10, "stocking shows up");
+
+        Intents::transfer(shelf, shelf.contents, hands, id, 4);
+        Intents::transfer(shelf, hands, cart, id, 1);
+        M_ASSERT(ledger.total(id, ItemLocation::Shelf) == onShelves + 6 &&
+                     ledger.total(id, ItemLocation::Employee) ==
+                         withEmployees + 3,
+                 "moves between locations");
+        M_ASSERT(ledger.total(id) == before + 9, "carts arent counted");
+
+        ItemGroup copy = hands;
+        M_ASSERT(ledger.total(id) == before + 12, "copies count");
+        copy = cart;
+        M_ASSERT(ledger.total(id) == before + 10, "assigning replaces");
+        hands.merge(cart);
+        M_ASSERT(ledger.total(id) == before + 11, "merges count");
+    }
+    M_ASSERT(ledger.total(id) == before, "gone with the groups");
+}
+
+void text_cache_test() {
+    // ints standing in for text meshes, there is no GL context in here
+    int built = 0;
+    int released = 0;
+    StringCache<int> cache;
+    cache.build = [&](const std::string&) { return ++built; };
+    cache.release = [&](int&) { released++; };
+
+    int a = cache.get("Customer 1");
+    M_ASSERT(cache.get("Customer 1") == a && built == 1 && cache.misses == 1,
+             "same text same mesh");
+    M_ASSERT(cache.get("Customer 2") != a && cache.entries.size() == 2,
+             "new text gets its own");
+    cache.endFrame();
+
+    // only keep using one of them
+    for (int i = 0; i < StringCache<int>::MAX_IDLE * 2; i++) {
+        cache.get("Customer 1");
+        cache.endFrame();
+    }
+    M_ASSERT(cache.entries.size() == 1 && released == 1 &&
+                 cache.get("Customer 1") == a,
+             "unused ones get released");
+    cache.clear();
+    M_ASSERT(released == 2, "clear releases everything");
+
+    // three overlays drawing text every frame is still one frame
+    TextCache text;
+    int jobs, profile, entities;
+    for (int i = 0; i < 3; i++) {
+        text.startDrawing(&jobs);
+        text.startDrawing(&profile);
+        text.startDrawing(&entities);
+    }
+    M_ASSERT(text.meshes.frame == 2, "frame moves once per app frame");
+}
+
+void textures_test() {
+    M_ASSERT(Textures::name(Textures::White) == "white" &&
+                 Textures::handle("shelf") == Textures::Shelf,
+             "builtins are there from the start");
+
+    // a copy of our own so nothing made up ends up in the real one, adding
+    // the files is left to SuperLayer once there is a renderer
+    Textures textures;
+    int before = (int)textures.names.size();
+    TextureHandle sub = textures.intern("character_tilesheet");
+    M_ASSERT((int)textures.names.size() == before + 1 &&
+                 textures.names[sub] == "character_tilesheet" &&
+                 textures.intern("character_tilesheet") == sub,
+             "same name same handle");
+    M_ASSERT(textures.intern("box") == Textures::Box, "builtins keep theirs");
+}
+
+void item_catalog_test() {
+    ItemManager& items = ItemManager::get();
+    ItemManager saved = items;
+
+    std::stringstream file(
+        "egg,1.5,egg\r\n"
+        "# comments and blank lines are skipped\n"
+        "\n"
+        "milk,2,milk,0.5,0.5,1,1\r\n"
+        "no price here\n"
+        "bread,abc,egg\n"
+        "cake,2,egg,1,1,x,1\n"
+        "pizza,3,egg\n");
+    M_ASSERT(items.load(file) == 3 && items.name(2) == "pizza",
+             "read every good line, bad numbers skipped");
+    M_ASSERT(items.name(1) == "milk" && items.price(1) == 2.f,
+             "ids go in file order");
+    M_ASSERT(items.color(1) == (glm::vec4{0.5f, 0.5f, 1.f, 1.f}),
+             "color is optional");
+    M_ASSERT(items.textureName(2) == "egg" &&
+                 items.textures[2] == items.textures[0],
+             "textures are shared (even with windows line endings)");
+    M_ASSERT(items.longestName == 5, "tracks the longest name");
+
+    items.generate(30000);
+    M_ASSERT(items.size() == 30000 && items.name(29997) == "egg",
+             "generate cycles the real ones");
+    items.update_average(29997, 2.5f);
+    M_ASSERT(items.get_avg_price(29997) == 2.f, "running average");
+
+    items = saved;
+}
+
+void view_culling_test() {
+    // looking at (10, 20), 8 wide and 6 tall
+    glm::mat4 projection = glm::ortho(-4.f, 4.f, -3.f, 3.f);
+    glm::mat4 view =
+        glm::translate(glm::mat4(1.f), glm::vec3{-10.f, -20.f, 0.f});
+    glm::vec4 r = ViewCulling::visibleRect(view, projection, 0.f);
+    M_ASSERT(glm::distance(glm::vec2{r.x, r.y}, glm::vec2{6.f, 17.f}) < 0.01f &&
+                 glm::distance(glm::vec2{r.z, r.w}, glm::vec2{14.f, 23.f}) <
+                     0.01f,
+             "visible rect comes from the camera");
+    M_ASSERT(ViewCulling::overlaps(r, glm::vec2{13.5f, 22.5f}, glm::vec2{1.f}),
+             "half on screen counts");
+    M_ASSERT(!ViewCulling::overlaps(r, glm::vec2{15.f, 20.f}, glm::vec2{1.f}),
+             "off screen doesnt");
+
+    // straight into the grid so no layout listeners hear about these
+    auto person = std::make_shared<Customer>();
+    person->position = glm::vec2{10.f, 20.f};
+    auto shelf = std::make_shared<Shelf>(glm::vec2{10.f, 20.f}, glm::vec2{1.f},
+                                         0.f, glm::vec4{1.f}, "shelf");
+    auto away = std::make_shared<Shelf>(glm::vec2{50.f, 20.f}, glm::vec2{1.f},
+                                        0.f, glm::vec4{1.f}, "shelf");
+    for (auto e : std::vector<std::shared_ptr<Entity>>{person, shelf, away}) {
+        SpatialIndex::grid().insert(e);
+    }
+    CullStats saved = ViewCulling::stats();
+    ViewCulling::stats() = CullStats();
+    std::vector<int> drawn;
+    ViewCulling::forEachEntityIn(
+        r, [&](const auto& e) { drawn.push_back(e->id); });
+    M_ASSERT(drawn == (std::vector<int>{shelf->id, person->id}),
+             "only whats on screen, people on top");
+    M_ASSERT(ViewCulling::stats().visible == 2 &&
+                 ViewCulling::stats().culled ==
+                     (int)SpatialIndex::grid().size() - 2,
+             "counts what got skipped");
+    ViewCulling::stats() = saved;
+    for (auto e : std::vector<std::shared_ptr<Entity>>{person, shelf, away}) {
+        SpatialIndex::grid().remove(e->id);
+    }
+}
+
+void stock_index_test() {
+    StockIndex& index = StockIndex::get();
+    // nothing else uses ids this high
+    const int milk = 9001;
+    const int eggs = 9002;
+    auto near = std::make_shared<Shelf>(glm::vec2{1.f, 0.f}, glm::vec2{1.f},
+                                        0.f, glm::vec4{1.f}, "shelf");
+    auto far = std::make_shared<Shelf>(glm::vec2{8.f, 0.f}, glm::vec2{1.f},
+                                       0.f, glm::vec4{1.f}, "shelf");
+    auto box = std::make_shared<Storage>(glm::vec2{2.f, 0.f}, glm::vec2{1.f},
+                                         0.f, glm::vec4{1.f}, "box");
+    far->contents.addItem(milk, 3);
+    box->contents.addItem(milk, 3);
+    StockIndex::onLayoutChanged(near, true);
+    StockIndex::onLayoutChanged(far, true);
+    StockIndex::onLayoutChanged(box, true);
+    M_ASSERT(index.stocking(milk).size() == 2, "whatever was there is indexed");
+
+    auto shelves = SpatialIndex::getEntityInRangeWithItem<Shelf>(
+        glm::vec2{0.f, 0.f}, milk, -1);
+    M_ASSERT(shelves.size() == 1 && shelves[0] == far, "only shelves");
+
+    near->contents.addItem(milk, 1);
+    shelves = SpatialIndex::getEntityInRangeWithItem<Shelf>(
+        glm::vec2{0.f, 0.f}, milk, -1);
+    M_ASSERT(shelves.size() == 2 && shelves[0] == near, "nearest first");
+    shelves = SpatialIndex::getEntityInRangeWithItem<Shelf>(
+        glm::vec2{0.f, 0.f}, milk, 3.f);
+    M_ASSERT(shelves.size() == 1, "range still applies");
+
+    // sold out still counts as stocking it, like before
+    near->contents.removeItem(milk, 1);
+    M_ASSERT(index.stocking(milk).size() == 3, "empty entries stay");
+    near->contents.removeItem(milk, 1);
+    M_ASSERT(index.stocking(milk).size() == 2, "gone once removed");
+
+    ItemGroup delivery;
+    delivery.addItem(eggs, 2);
+    delivery.addItem(milk, 2);
+    far->contents.merge(delivery);
+    M_ASSERT(index.stocking(eggs).size() == 1 &&
+                 index.stocking(milk).size() == 2,
+             "merging adds new ids once");
+    box->contents = delivery;
+    M_ASSERT(index.stocking(eggs).size() == 2, "assigning replaces");
+
+    StockIndex::onLayoutChanged(far, false);
+    M_ASSERT(index.stocking(eggs).size() == 1, "removed with the shelf");
+    StockIndex::onLayoutChanged(near, false);
+    StockIndex::onLayoutChanged(box, false);
+    M_ASSERT(index.stocking(milk).empty() && index.stocking(eggs).empty(),
+             "nothing left");
+    far->contents.addItem(milk, 1);
+    M_ASSERT(index.stocking(milk).empty(), "not listening to removed shelves");
+}
+
+void rng_test() {
+    auto draw = [](Rng rng) {
+        std::vector<uint64_t> out;
+        for (int i = 0; i < 100; i++) out.push_back(rng.next());
+        return out;
+    };
+
+    RngService& service = RngService::get();
+    uint64_t oldSeed = service.seed;
+    Rng oldMain = service.main;
+
+    service.reseed(42);
+    auto a = draw(service.forEntity(7));
+    auto main = draw(service.main);
+    M_ASSERT(a != draw(service.forEntity(8)), "entities get their own stream");
+    M_ASSERT(a != main, "entities dont share with main");
+    service.reseed(43);
+    M_ASSERT(a != draw(service.forEntity(7)), "seed changes everything");
+    service.reseed(42);
+    M_ASSERT(a == draw(service.forEntity(7)), "same seed same numbers");
+    M_ASSERT(main == draw(service.main), "same seed same numbers");
+
+    Rng rng = service.forEntity(1);
+    bool seen[6] = {false};
+    for (int i = 0; i < 1000; i++) {
+        int r = rng.range(-2, 3);
+        M_ASSERT(r >= -2 && r <= 3, "range is inclusive");
+        seen[r + 2] = true;
+        float f = rng.uniform();
+        M_ASSERT(f >= 0.f && f < 1.f, "uniform is [0, 1)");
+    }
+    for (bool b : seen) M_ASSERT(b, "every value comes up");
+    M_ASSERT(rng.range(4, 4) == 4, "single value range");
+    M_ASSERT(rng.range(0, -1) == 0, "empty range doesnt divide by zero");
+    M_ASSERT(abs(glm::length(rng.circular(5.f)) - 5.f) < 0.001f,
+             "circular is on the circle");
+
+    service.seed = oldSeed;
+    service.main = oldMain;
+}
+
 void all_tests() {
     prof give_me_a_name(__PROFILE_FUNC__);
     theta_test();
     point_collision_test();
+    spatial_hash_test();
+    occupancy_grid_test();
+    path_service_test();
+    path_cache_test();
+    path_cache_ends_test();
+    flow_field_test();
+    path_hierarchy_test();
+    job_queue_test();
+    if (getenv("STRESS_TESTS")) {
+        job_queue_stress_test(40, 500);
+    } else {
+        job_queue_stress_test(4, 100);
+    }
+    job_assigner_test();
+    entity_update_test();
+    item_group_test();
+    inventory_ledger_test();
+    text_cache_test();
+    textures_test();
+    item_catalog_test();
+    view_culling_test();
+    stock_index_test();
+    rng_test();
+    movement_test();
 
     {  // make sure linear interp always goes up
         float c = 0.f;
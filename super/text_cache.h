@@ -0,0 +1,133 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Something built from a string (like a text mesh) kept around by that
+// string, so asking for the same one again is just a lookup. Anything that
+// nobody asked for in MAX_IDLE frames (endFrame() calls) gets released
+template <typename T>
+struct StringCache {
+    static constexpr int MAX_IDLE = 120;
+
+    struct Entry {
+        T value;
+        int lastUsed;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    std::function<T(const std::string&)> build;
+    std::function<void(T&)> release;
+    int frame = 0;
+    // how many times build ran since this was last reset
+    int misses = 0;
+
+    ~StringCache() { clear(); }
+
+    T& get(const std::string& content) {
+        auto it = entries.find(content);
+        if (it == entries.end()) {
+            it = entries.emplace(content, Entry{build(content), frame}).first;
+            misses++;
+        }
+        it->second.lastUsed = frame;
+        return it->second.value;
+    }
+
+    void endFrame() {
+        frame++;
+        if (frame % MAX_IDLE == 0) evict();
+    }
+
+    void evict() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (frame - it->second.lastUsed < MAX_IDLE) {
+                it++;
+                continue;
+            }
+            release(it->second.value);
+            it = entries.erase(it);
+        }
+    }
+
+    void clear() {
+        for (auto& kv : entries) release(kv.second.value);
+        entries.clear();
+    }
+};
+
+// Keeps glText around between frames for the debug overlays.
+//
+// glText builds its glyph atlas in gltInit() and a mesh for every string in
+// gltSetText(), doing both every frame for every label was most of what the
+// overlays cost. Now the atlas is built once and the meshes are kept by
+// their text, so a label that reads the same as last frame is just a draw.
+//
+// Wrap drawing in begin(this) / end() instead of gltInit / gltTerminate,
+// and only once there is a GL context (so not from tests). Text that reads
+// differently every frame (timings and counters) should go through
+// drawUncached() so it doesnt fill the cache with meshes nobody will ask
+// for again
+struct TextCache {
+    StringCache<GLTtext*> meshes;
+    bool initialized = false;
+    // layers that drew since the frame started, one of them coming back
+    // means we are on the next frame
+    std::vector<const void*> drewThisFrame;
+    // drawUncached() meshes, deleted in end()
+    std::vector<GLTtext*> scratch;
+
+    TextCache() {
+        meshes.build = [](const std::string& content) {
+            GLTtext* text = gltCreateText();
+            gltSetText(text, content.c_str());
+            return text;
+        };
+        meshes.release = [](GLTtext*& text) { gltDeleteText(text); };
+    }
+
+    // never destroyed, the GL context is gone by the time statics are
+    inline static TextCache& get() {
+        static TextCache* cache = new TextCache();
+        return *cache;
+    }
+
+    // Every overlay calls begin(), so the cache only moves to the next frame
+    // once a layer (who) comes back for a second time
+    void startDrawing(const void* who) {
+        if (std::find(drewThisFrame.begin(), drewThisFrame.end(), who) !=
+            drewThisFrame.end()) {
+            meshes.endFrame();
+            drewThisFrame.clear();
+        }
+        drewThisFrame.push_back(who);
+    }
+
+    void begin(const void* who) {
+        if (!initialized) {
+            gltInit();
+            initialized = true;
+        }
+        startDrawing(who);
+        gltBeginDraw();
+    }
+
+    void end() {
+        gltEndDraw();
+        for (GLTtext* text : scratch) gltDeleteText(text);
+        scratch.clear();
+    }
+
+    GLTtext* text(const std::string& content) { return meshes.get(content); }
+
+    void draw2D(const std::string& content, float x, float y, float scale) {
+        gltDrawText2D(text(content), x, y, scale);
+    }
+
+    void drawUncached(const std::string& content, float x, float y,
+                      float scale) {
+        GLTtext* text = meshes.build(content);
+        gltDrawText2D(text, x, y, scale);
+        scratch.push_back(text);
+    }
+};
@@ -0,0 +1,77 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "../vendor/supermarket-engine/engine/renderer.h"
+
+// Small int standing in for a texture or subtexture name, so game code can
+// keep and compare them without touching strings
+typedef int TextureHandle;
+
+// Every texture name the game knows about gets a handle the first time it is
+// seen and keeps it for the rest of the run. The renderer still wants the
+// name, name(handle) hands back the one interned copy so drawing never
+// builds a string.
+//
+// Register with add() / addSubtexture() (see the SuperLayer constructor)
+// instead of calling the Renderer directly so the handle comes back with it
+struct Textures {
+    // the ones gameplay code needs to tell apart, interned up front so they
+    // have these handles no matter when (or if) their files get loaded
+    enum Builtin : TextureHandle {
+        White = 0,
+        Shelf,
+        Box,
+    };
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, TextureHandle> handles;
+
+    Textures() {
+        for (const char* name : {"white", "shelf", "box"}) intern(name);
+    }
+
+    // never destroyed, same as the ItemManager
+    inline static Textures& get() {
+        static Textures* textures = new Textures();
+        return *textures;
+    }
+
+    TextureHandle intern(const std::string& name) {
+        auto it = handles.find(name);
+        if (it != handles.end()) return it->second;
+        TextureHandle handle = (TextureHandle)names.size();
+        handles.emplace(name, handle);
+        names.push_back(name);
+        return handle;
+    }
+
+    static TextureHandle handle(const std::string& name) {
+        return get().intern(name);
+    }
+
+    static const std::string& name(TextureHandle handle) {
+        return get().names[handle];
+    }
+
+    static int count() { return (int)get().names.size(); }
+
+    // The renderer names a texture after its file, "./resources/box.png"
+    // is "box"
+    static TextureHandle add(const std::string& filename) {
+        Renderer::addTexture(filename);
+        size_t slash = filename.find_last_of("/\\");
+        size_t start = slash == std::string::npos ? 0 : slash + 1;
+        size_t dot = filename.find_last_of('.');
+        if (dot == std::string::npos || dot < start) dot = filename.size();
+        return handle(filename.substr(start, dot - start));
+    }
+
+    static TextureHandle addSubtexture(const std::string& texture,
+                                       const std::string& name, float x,
+                                       float y, float w, float h) {
+        Renderer::addSubtexture(texture, name, x, y, w, h);
+        return handle(name);
+    }
+};
+
@@ -0,0 +1,112 @@
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+
+// Fixed set of threads for splitting one big loop per frame across cores
+// (see EntityUpdater). Tasks are handed out one at a time from a shared
+// counter so whoever finishes early just grabs the next one, and the
+// calling thread works too instead of sitting there waiting.
+//
+// Not for long running work like path searches, those go to PathService
+struct ThreadPool {
+    // what one parallelFor call is working through, workers keep their own
+    // reference so a slow one waking up late cant mix up two calls
+    struct Batch {
+        const std::function<void(int)>* fn;
+        int numTasks;
+        std::atomic<int> next{0};
+        std::atomic<int> finished{0};
+    };
+
+    int numWorkers = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::shared_ptr<Batch> batch;
+    bool stopping = false;
+
+    ThreadPool() {}
+    explicit ThreadPool(int workers) : numWorkers(workers) {}
+    ~ThreadPool() { stop(); }
+
+    // Calls fn(0) .. fn(numTasks - 1) spread over the workers, returns once
+    // all of them are done
+    void parallelFor(int numTasks, const std::function<void(int)>& fn) {
+        if (numTasks <= 0) return;
+        if (numWorkers == 0 || numTasks == 1) {
+            for (int i = 0; i < numTasks; i++) fn(i);
+            return;
+        }
+        if (workers.empty()) startWorkers();
+
+        auto b = std::make_shared<Batch>();
+        b->fn = &fn;
+        b->numTasks = numTasks;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch = b;
+        }
+        wake.notify_all();
+
+        work(*b);
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&]() {
+            return b->finished.load(std::memory_order_acquire) == numTasks;
+        });
+        batch.reset();
+    }
+
+    void work(Batch& b) {
+        while (true) {
+            int i = b.next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= b.numTasks) return;
+            (*b.fn)(i);
+            if (b.finished.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+                b.numTasks) {
+                std::lock_guard<std::mutex> lock(mutex);
+                idle.notify_all();
+            }
+        }
+    }
+
+    void startWorkers() {
+        for (int i = 0; i < numWorkers; i++) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    void workerLoop() {
+        std::shared_ptr<Batch> last;
+        while (true) {
+            std::shared_ptr<Batch> b;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() {
+                    return stopping || (batch && batch != last);
+                });
+                if (stopping) return;
+                b = batch;
+            }
+            last = b;
+            work(*b);
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+        workers.clear();
+        stopping = false;
+    }
+};
@@ -14,6 +14,7 @@
 //
 #include "entities.h"
 #include "menu.h"
+#include "text_cache.h"
 
 struct UITestLayer : public Layer {
     float value = 0.08f;
@@ -65,15 +66,11 @@ struct UITestLayer : public Layer {
             uiTestCameraController->onUpdate(dt);
         }
 
-        gltInit();
-        gltBeginDraw();
+        TextCache::get().begin(this);
         gltColor(1.0f, 1.0f, 1.0f, 1.0f);
-        GLTtext* text = gltCreateText();
-        gltSetText(text, stateToString(Menu::get().state));
-        gltDrawText2D(text, 150, 150, 5.f);
-        gltEndDraw();
-        gltDeleteText(text);
-        gltTerminate();
+        TextCache::get().draw2D(stateToString(Menu::get().state), 150, 150,
+                                5.f);
+        TextCache::get().end();
 
         Renderer::begin(uiTestCameraController->camera);
         ui_test(dt);
@@ -0,0 +1,76 @@
+
+#pragma once
+
+#include "../vendor/supermarket-engine/engine/pch.hpp"
+#include "spatial_index.h"
+
+// How much of the world got drawn last frame and how much was skipped for
+// being off screen, shown in the profiler
+struct CullStats {
+    int visible = 0;
+    int culled = 0;
+};
+
+static CullStats cullStats_DO_NOT_USE;
+
+// Helpers for only drawing what the camera can see. The rect is in world
+// space as (minx, miny, maxx, maxy) like getEntityInSelection
+struct ViewCulling {
+    // anything this close to the edge still gets drawn, covers quads that
+    // hang over the side of their chunk or cell
+    static constexpr float MARGIN = 2.f;
+
+    static CullStats& stats() { return cullStats_DO_NOT_USE; }
+
+    static void note(int visible, int culled) {
+        stats().visible += visible;
+        stats().culled += culled;
+    }
+
+    // Whatever the camera can see, from the corners of clip space
+    static glm::vec4 visibleRect(const glm::mat4& view,
+                                 const glm::mat4& projection,
+                                 float margin = MARGIN) {
+        glm::mat4 toWorld = glm::inverse(projection * view);
+        glm::vec2 lo{std::numeric_limits<float>::max()};
+        glm::vec2 hi{std::numeric_limits<float>::lowest()};
+        for (float x : {-1.f, 1.f}) {
+            for (float y : {-1.f, 1.f}) {
+                glm::vec4 p = toWorld * glm::vec4{x, y, 0.f, 1.f};
+                glm::vec2 world = glm::vec2{p.x, p.y} / p.w;
+                lo = glm::min(lo, world);
+                hi = glm::max(hi, world);
+            }
+        }
+        return glm::vec4{lo.x - margin, lo.y - margin, hi.x + margin,
+                         hi.y + margin};
+    }
+
+    static bool overlaps(const glm::vec4& rect, const glm::vec2& pos,
+                         const glm::vec2& size) {
+        glm::vec2 lo = glm::min(pos, pos + size);
+        glm::vec2 hi = glm::max(pos, pos + size);
+        return lo.x <= rect.z && hi.x >= rect.x && lo.y <= rect.w &&
+               hi.y >= rect.y;
+    }
+
+    // Everything on screen, from the spatial index. Furniture goes first so
+    // the people always end up on top of it
+    template <typename Fn>
+    static void forEachEntityIn(const glm::vec4& rect, Fn fn) {
+        int visible = 0;
+        for (bool moving : {false, true}) {
+            SpatialIndex::grid().forEachInRect(
+                rect, [&](const std::shared_ptr<Entity>& e) {
+                    if (e->canMove() != moving)
+                        return EntityHelper::ForEachFlow::Continue;
+                    if (!overlaps(rect, e->position, e->size))
+                        return EntityHelper::ForEachFlow::Continue;
+                    fn(e);
+                    visible++;
+                    return EntityHelper::ForEachFlow::None;
+                });
+        }
+        note(visible, (int)SpatialIndex::grid().size() - visible);
+    }
+};